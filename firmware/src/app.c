@@ -16,8 +16,10 @@
 
 #include "definitions.h"
 #include "drivers/counter.h"
+#include "drivers/die_temp.h"
 #include "drivers/hang_here.h"
 #include "drivers/mcp4728.h"
+#include "drivers/timebase.h"
 #include "drivers/zl30159.h"
 #include "modbus/modbus.h"
 
@@ -28,6 +30,54 @@
 #define MB_PLL_GPIO_BASE (0x200U)
 #define MB_DAC_RAW_BASE (0x300U)
 #define MB_DAC_MAX_WRITE MODBUS_REGS_MULTI_MAX
+#define MB_COUNTER_BASE (0x400U)
+#define MB_COUNTER_REGS (0x100U)  // per channel
+#define MB_RAW_BASE (0x600U)
+#define MB_RAW_RECORD_REGS (12U)
+#define MB_RAW_RECORDS_MAX ((MODBUS_REGS_MULTI_MAX - 1) / MB_RAW_RECORD_REGS)
+#define MB_LINK_BASE (0x700U)
+#define MB_LINK_MODE (0x00U)  // u16, read/write, mb_transport_t
+#define MB_LINK_IN_USE (0x01U)  // u16, mb_transport_t
+#define MB_LINK_REGS (0x02U)
+
+// Counter register offsets from the base of each channel's block, which is
+// MB_COUNTER_BASE + (channel * MB_COUNTER_REGS). Doubles take four registers
+// and 32-bit integers two, most significant word first. Ratio, timebase,
+// temperature, mode and pulse registers read the same in every block, and can
+// only be written in the CC_REF block. A fixed MB_CTR_GATE_MS gives one result
+// per gate only for inputs with 2 edges a gate, 16 on input capture.
+#define MB_CTR_FREQ (0x00U)  // double, Hz
+#define MB_CTR_STATS_COUNT (0x04U)  // u32
+#define MB_CTR_STATS_MEAN (0x06U)  // double, Hz
+#define MB_CTR_STATS_STDDEV (0x0AU)  // double, Hz
+#define MB_CTR_STATS_MIN (0x0EU)  // double, Hz
+#define MB_CTR_STATS_MAX (0x12U)  // double, Hz
+#define MB_CTR_ADEV_TAU0 (0x20U)  // double, s
+#define MB_CTR_ADEV (0x24U)  // double[ADEV_LEVELS], tau = tau0 * 2^n
+#define MB_CTR_ADEV_TERMS (0x50U)  // u32[ADEV_LEVELS]
+#define MB_CTR_GATE_MS (0x66U)  // u32, ms, read/write, 0 is automatic gate
+#define MB_CTR_RESULT_TICKS (0x68U)  // u32, core timer at end of latest gate
+#define MB_CTR_RATIO (0x6AU)  // double, A/B in ratio mode, else zero
+#define MB_CTR_RATIO_MODE (0x6EU)  // u16, read/write, 1 is ratio mode
+#define MB_CTR_TB_REF (0x70U)  // double, Hz, read/write, 0 stops disciplining
+#define MB_CTR_TB_PPB (0x74U)  // double, read/write, core timer error
+#define MB_CTR_TB_SAMPLES (0x78U)  // u32, results since reference was set
+#define MB_CTR_TB_STATE (0x7AU)  // u16, tb_state_t
+#define MB_CTR_RECENT (0x80U)  // double[STATS_RECENT_LEN], Hz, newest first
+#define MB_CTR_TC_MODEL (0xC0U)  // double[TB_MODEL_TERMS], read/write, ppb
+#define MB_CTR_TC_LEARN (0xCCU)  // u16, read/write, 1 is learning
+#define MB_CTR_TC_TEMP (0xD0U)  // double, C, die temperature
+#define MB_CTR_TC_PPB (0xD4U)  // double, temperature correction in use
+#define MB_CTR_KF_FREQ (0xD8U)  // double, Hz, Kalman filtered
+#define MB_CTR_KF_DRIFT (0xDCU)  // double, Hz/s
+#define MB_CTR_KF_FREQ_SD (0xE0U)  // double, Hz
+#define MB_CTR_KF_DRIFT_SD (0xE4U)  // double, Hz/s
+#define MB_CTR_KF_MODE (0xE8U)  // u16, read/write, 1 is filter on
+#define MB_CTR_MODE (0xEAU)  // u16, read/write, counter_mode_t
+#define MB_CTR_PERIOD (0xECU)  // double, s, period and pulse modes
+#define MB_CTR_WIDTH (0xF0U)  // double, s, pulse mode
+#define MB_CTR_DUTY (0xF4U)  // double, 0.0 to 1.0, pulse mode
+#define MB_CTR_KF_NOISE (0xF8U)  // double, s, read/write, 0 is backend default
 
 
 /// Definitions
@@ -51,6 +101,24 @@ bool modbus_read_pll_gpio_callback (mb_reg_data_t* reg_data);
 bool modbus_write_pll_gpio_callback (mb_reg_data_t* reg_data);
 bool modbus_read_dac_raw_callback (mb_reg_data_t* reg_data);
 bool modbus_write_dac_raw_callback (mb_reg_data_t* reg_data);
+bool modbus_read_counter_callback (mb_reg_data_t* reg_data);
+bool modbus_write_counter_gate_callback (mb_reg_data_t* reg_data);
+bool modbus_write_counter_ratio_callback (mb_reg_data_t* reg_data);
+bool modbus_write_timebase_callback (mb_reg_data_t* reg_data);
+bool modbus_write_tempco_callback (mb_reg_data_t* reg_data);
+bool modbus_write_counter_kalman_callback (mb_reg_data_t* reg_data);
+bool modbus_write_counter_kalman_noise_callback (mb_reg_data_t* reg_data);
+bool modbus_write_counter_mode_callback (mb_reg_data_t* reg_data);
+bool modbus_read_counter_raw_callback (mb_reg_data_t* reg_data);
+bool modbus_read_link_callback (mb_reg_data_t* reg_data);
+bool modbus_write_link_callback (mb_reg_data_t* reg_data);
+
+static void mb_pack_u32 (uint16_t* regs, uint32_t value);
+static uint32_t mb_unpack_u32 (const uint16_t* regs);
+static void mb_pack_double (uint16_t* regs, double value);
+static double mb_unpack_double (const uint16_t* regs);
+static counter_channel_t mb_counter_channel (uint16_t address);
+static uint16_t mb_counter_offset (uint16_t address);
 
 
 /// Main Functions
@@ -114,10 +182,13 @@ app_init (void)
 
 	modbus_init();
 	zl_init();
+	timebase_init();
+	die_temp_init();
 	counter_init();
 
 	// PLL can be accessed via Read Holding Registers (0x03) and Write Multiple
-	// Registers (0x10) Modbus functions in ASCII frame format over USB serial.
+	// Registers (0x10) Modbus functions in ASCII, RTU or MBAP frame format over
+	// USB serial. See MB_LINK_MODE for choosing one.
 	// Note that we go by ADDRESSES always, not register numbers. If you have
 	// to use a "number" add one to the address.
 	// Also note that ONLY 123 registers can be read/written at once. This is
@@ -163,6 +234,96 @@ app_init (void)
 		MB_RA_WRITE,
 		modbus_write_dac_raw_callback
 	);
+	// Counter results, one block per channel. See MB_CTR_* for the layout.
+	// Only the gate time, ratio mode, timebase calibration, temperature model,
+	// Kalman filter mode and noise, and measurement mode can be written.
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE,
+		MB_COUNTER_REGS * COUNTER_CHANNELS,
+		MB_RA_READ,
+		modbus_read_counter_callback
+	);
+	// Raw counter records, drained by reading. See
+	// modbus_read_counter_raw_callback() for the layout.
+	modbus_add_reg_handler(
+		MB_RAW_BASE,
+		MODBUS_REGS_MULTI_MAX,
+		MB_RA_READ,
+		modbus_read_counter_raw_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + MB_CTR_GATE_MS,
+		0x02,
+		MB_RA_WRITE,
+		modbus_write_counter_gate_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + MB_CTR_RATIO_MODE,
+		0x01,
+		MB_RA_WRITE,
+		modbus_write_counter_ratio_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + MB_CTR_TB_REF,
+		0x08,
+		MB_RA_WRITE,
+		modbus_write_timebase_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + MB_CTR_TC_MODEL,
+		(TB_MODEL_TERMS * 4) + 1,
+		MB_RA_WRITE,
+		modbus_write_tempco_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + MB_CTR_KF_MODE,
+		0x01,
+		MB_RA_WRITE,
+		modbus_write_counter_kalman_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + MB_CTR_MODE,
+		0x01,
+		MB_RA_WRITE,
+		modbus_write_counter_mode_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + MB_CTR_KF_NOISE,
+		0x04,
+		MB_RA_WRITE,
+		modbus_write_counter_kalman_noise_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + (CC_X1 * MB_COUNTER_REGS) + MB_CTR_GATE_MS,
+		0x02,
+		MB_RA_WRITE,
+		modbus_write_counter_gate_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + (CC_X1 * MB_COUNTER_REGS) + MB_CTR_KF_MODE,
+		0x01,
+		MB_RA_WRITE,
+		modbus_write_counter_kalman_callback
+	);
+	modbus_add_reg_handler(
+		MB_COUNTER_BASE + (CC_X1 * MB_COUNTER_REGS) + MB_CTR_KF_NOISE,
+		0x04,
+		MB_RA_WRITE,
+		modbus_write_counter_kalman_noise_callback
+	);
+	// Link framing. Only the mode can be written.
+	modbus_add_reg_handler(
+		MB_LINK_BASE,
+		MB_LINK_REGS,
+		MB_RA_READ,
+		modbus_read_link_callback
+	);
+	modbus_add_reg_handler(
+		MB_LINK_BASE + MB_LINK_MODE,
+		0x01,
+		MB_RA_WRITE,
+		modbus_write_link_callback
+	);
 }
 
 // Main app task. Call as often as possible.
@@ -281,6 +442,7 @@ app_task (void)
 	{
 		// General tasks for after init.
 		modbus_task();
+		die_temp_task();
 		counter_task();
 	}
 }
@@ -591,3 +753,385 @@ modbus_write_dac_raw_callback (mb_reg_data_t* reg_data)
 
 	return true;
 }
+
+// Read counter results. Registers are refreshed from the counter on every
+// read, so a multi-register read of a double is always self-consistent. A
+// read can't span two channel blocks.
+// Unused registers read as zero. With a fixed gate, the stats count and the
+// recent results let the host read a batch of up to STATS_RECENT_LEN results
+// at once.
+bool
+modbus_read_counter_callback (mb_reg_data_t* reg_data)
+{
+	uint16_t regs[MB_COUNTER_REGS] = { 0 };
+	counter_channel_t ch = mb_counter_channel(reg_data->address);
+	uint16_t offset = mb_counter_offset(reg_data->address);
+	const stats_t* stats = counter_stats(ch);
+	const adev_t* adev = counter_adev(ch);
+	const kalman_t* kf = counter_kalman(ch);
+	double recent[STATS_RECENT_LEN];
+	double model[TB_MODEL_TERMS];
+	unsigned int i, n_recent;
+
+	if ((offset + reg_data->count) > MB_COUNTER_REGS)
+	{
+		return false;
+	}
+
+	mb_pack_double(&regs[MB_CTR_FREQ], counter_freq_hz(ch));
+	mb_pack_u32(&regs[MB_CTR_STATS_COUNT], stats->count);
+	mb_pack_double(&regs[MB_CTR_STATS_MEAN], stats->mean);
+	mb_pack_double(&regs[MB_CTR_STATS_STDDEV], stats_stddev(stats));
+	mb_pack_double(&regs[MB_CTR_STATS_MIN], stats->min);
+	mb_pack_double(&regs[MB_CTR_STATS_MAX], stats->max);
+	mb_pack_double(&regs[MB_CTR_ADEV_TAU0], adev->tau0);
+
+	for (i = 0; i < ADEV_LEVELS; i++)
+	{
+		mb_pack_double(&regs[MB_CTR_ADEV + (i * 4)], adev_get(adev, i));
+		mb_pack_u32(&regs[MB_CTR_ADEV_TERMS + (i * 2)], adev_terms(adev, i));
+	}
+
+	mb_pack_u32(&regs[MB_CTR_GATE_MS], counter_gate_ms(ch));
+	mb_pack_u32(&regs[MB_CTR_RESULT_TICKS], counter_result_ticks(ch));
+	mb_pack_double(&regs[MB_CTR_RATIO], counter_ratio());
+	regs[MB_CTR_RATIO_MODE] = counter_ratio_mode();
+	mb_pack_double(&regs[MB_CTR_TB_REF], timebase_reference());
+	mb_pack_double(&regs[MB_CTR_TB_PPB], timebase_ppb());
+	mb_pack_u32(&regs[MB_CTR_TB_SAMPLES], timebase_samples());
+	regs[MB_CTR_TB_STATE] = timebase_state();
+	timebase_model(model);
+
+	for (i = 0; i < TB_MODEL_TERMS; i++)
+	{
+		mb_pack_double(&regs[MB_CTR_TC_MODEL + (i * 4)], model[i]);
+	}
+
+	regs[MB_CTR_TC_LEARN] = timebase_learning();
+	mb_pack_double(&regs[MB_CTR_TC_TEMP], die_temp_c());
+	mb_pack_double(&regs[MB_CTR_TC_PPB], timebase_temp_ppb());
+	mb_pack_double(&regs[MB_CTR_KF_FREQ], kf->freq);
+	mb_pack_double(&regs[MB_CTR_KF_DRIFT], kf->drift);
+	mb_pack_double(&regs[MB_CTR_KF_FREQ_SD], kalman_freq_sd(kf));
+	mb_pack_double(&regs[MB_CTR_KF_DRIFT_SD], kalman_drift_sd(kf));
+	regs[MB_CTR_KF_MODE] = counter_kalman_mode(ch);
+	mb_pack_double(&regs[MB_CTR_KF_NOISE], counter_kalman_noise(ch));
+	regs[MB_CTR_MODE] = counter_mode();
+	mb_pack_double(&regs[MB_CTR_PERIOD], counter_period_s());
+	mb_pack_double(&regs[MB_CTR_WIDTH], counter_width_s());
+	mb_pack_double(&regs[MB_CTR_DUTY], counter_duty());
+	n_recent = stats_recent(stats, recent, STATS_RECENT_LEN);
+
+	for (i = 0; i < n_recent; i++)
+	{
+		mb_pack_double(&regs[MB_CTR_RECENT + (i * 4)], recent[i]);
+	}
+
+	for (i = 0; i < reg_data->count; i++)
+	{
+		reg_data->data[i] = regs[offset + i];
+	}
+
+	return true;
+}
+
+// Drain raw counter records, oldest first. The read must start at MB_RAW_BASE.
+// The first register is the number of records that follow, up to as many as
+// fit the read. Each is MB_RAW_RECORD_REGS registers: seq, ct_start, ct_stop,
+// period and n as u32, then prescale and channel as u16. Records read are
+// gone, so a read that isn't answered loses them - seq shows the gap.
+bool
+modbus_read_counter_raw_callback (mb_reg_data_t* reg_data)
+{
+	counter_raw_t raw[MB_RAW_RECORDS_MAX];
+	unsigned int i, n;
+
+	if (reg_data->address != MB_RAW_BASE)
+	{
+		return false;
+	}
+
+	for (i = 0; i < reg_data->count; i++)
+	{
+		reg_data->data[i] = 0;
+	}
+
+	n = counter_raw_read(raw, (reg_data->count - 1) / MB_RAW_RECORD_REGS);
+	reg_data->data[0] = n;
+
+	for (i = 0; i < n; i++)
+	{
+		uint16_t* regs = &reg_data->data[1 + (i * MB_RAW_RECORD_REGS)];
+
+		mb_pack_u32(&regs[0], raw[i].seq);
+		mb_pack_u32(&regs[2], raw[i].ct_start);
+		mb_pack_u32(&regs[4], raw[i].ct_stop);
+		mb_pack_u32(&regs[6], raw[i].period);
+		mb_pack_u32(&regs[8], raw[i].n);
+		regs[10] = raw[i].prescale;
+		regs[11] = raw[i].channel;
+	}
+
+	return true;
+}
+
+// Set the counter gate time in ms, as a u32 across both registers. Zero
+// returns to automatic gate length. Out of range values are rejected. Each
+// gate needs at least 2 input edges (16 on input capture), and slower inputs
+// give results further apart than the gate. See counter_set_gate_ms().
+bool
+modbus_write_counter_gate_callback (mb_reg_data_t* reg_data)
+{
+	if ((mb_counter_offset(reg_data->address) != MB_CTR_GATE_MS) || (reg_data->count != 2))
+	{
+		return false;
+	}
+
+	return counter_set_gate_ms(mb_counter_channel(reg_data->address), mb_unpack_u32(reg_data->data));
+}
+
+// Enter (1) or leave (0) counter ratio mode. Other values are rejected.
+bool
+modbus_write_counter_ratio_callback (mb_reg_data_t* reg_data)
+{
+	if (reg_data->data[0] > 1)
+	{
+		return false;
+	}
+
+	counter_set_ratio(1 == reg_data->data[0]);
+
+	return true;
+}
+
+// Set the timebase reference frequency and/or correction, as whole doubles.
+// Writing the correction lets the host restore one measured earlier, without
+// waiting for the reference to be acquired again.
+bool
+modbus_write_timebase_callback (mb_reg_data_t* reg_data)
+{
+	uint16_t offset = reg_data->address - MB_COUNTER_BASE;
+	unsigned int i;
+
+	if ((reg_data->count % 4) != 0)
+	{
+		return false;
+	}
+
+	for (i = 0; i < reg_data->count; i += 4)
+	{
+		double value = mb_unpack_double(&reg_data->data[i]);
+
+		if ((offset + i) == MB_CTR_TB_REF)
+		{
+			timebase_set_reference(value);
+		}
+		else if ((offset + i) == MB_CTR_TB_PPB)
+		{
+			timebase_set_ppb(value);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Turn the counter Kalman filter on (1) or off (0). Other values are rejected.
+bool
+modbus_write_counter_kalman_callback (mb_reg_data_t* reg_data)
+{
+	if (reg_data->data[0] > 1)
+	{
+		return false;
+	}
+
+	counter_set_kalman(mb_counter_channel(reg_data->address), 1 == reg_data->data[0]);
+
+	return true;
+}
+
+// Set the counter Kalman filter's timestamp noise in s, as a whole double.
+// Zero returns to the backend's default, and negative values are rejected.
+bool
+modbus_write_counter_kalman_noise_callback (mb_reg_data_t* reg_data)
+{
+	double noise_s;
+
+	if ((mb_counter_offset(reg_data->address) != MB_CTR_KF_NOISE) || (reg_data->count != 4))
+	{
+		return false;
+	}
+
+	noise_s = mb_unpack_double(reg_data->data);
+
+	if (!(noise_s >= 0.0))
+	{
+		return false;
+	}
+
+	counter_set_kalman_noise(mb_counter_channel(reg_data->address), noise_s);
+
+	return true;
+}
+
+// Select the counter measurement mode, as a counter_mode_t. Other values are
+// rejected.
+bool
+modbus_write_counter_mode_callback (mb_reg_data_t* reg_data)
+{
+	if (reg_data->data[0] > CM_PULSE)
+	{
+		return false;
+	}
+
+	counter_set_mode((counter_mode_t)reg_data->data[0]);
+
+	return true;
+}
+
+// Read the link framing mode as set, and the framing in use, which differs in
+// automatic mode.
+bool
+modbus_read_link_callback (mb_reg_data_t* reg_data)
+{
+	uint16_t regs[MB_LINK_REGS];
+	unsigned int i;
+
+	regs[MB_LINK_MODE] = modbus_transport_mode();
+	regs[MB_LINK_IN_USE] = modbus_transport();
+
+	for (i = 0; i < reg_data->count; i++)
+	{
+		reg_data->data[i] = regs[(reg_data->address - MB_LINK_BASE) + i];
+	}
+
+	return true;
+}
+
+// Select the link framing, as an mb_transport_t. Other values are rejected.
+// The reply to this write goes out in the old framing. MBAP is never detected
+// automatically, so leaving it takes a write in MBAP framing, or a reset.
+bool
+modbus_write_link_callback (mb_reg_data_t* reg_data)
+{
+	return modbus_set_transport((mb_transport_t)reg_data->data[0]);
+}
+
+// Set temperature model coefficients, as whole doubles, and/or start (1) or
+// stop (0) learning. Coefficients not written keep their value. Stopping
+// learning replaces the model with the fit.
+bool
+modbus_write_tempco_callback (mb_reg_data_t* reg_data)
+{
+	uint16_t offset = reg_data->address - MB_COUNTER_BASE;
+	uint16_t end = offset + reg_data->count;  // exclusive
+	double model[TB_MODEL_TERMS];
+	unsigned int i;
+
+	if (((offset - MB_CTR_TC_MODEL) % 4) != 0)
+	{
+		return false;
+	}
+
+	if ((end <= MB_CTR_TC_LEARN) && (((end - MB_CTR_TC_MODEL) % 4) != 0))
+	{
+		return false;
+	}
+
+	if ((end > MB_CTR_TC_LEARN) && (reg_data->data[MB_CTR_TC_LEARN - offset] > 1))
+	{
+		return false;
+	}
+
+	timebase_model(model);
+
+	for (i = offset; ((i + 4) <= end) && (i < MB_CTR_TC_LEARN); i += 4)
+	{
+		model[(i - MB_CTR_TC_MODEL) / 4] = mb_unpack_double(&reg_data->data[i - offset]);
+	}
+
+	if (offset < MB_CTR_TC_LEARN)
+	{
+		timebase_set_model(model);
+	}
+
+	if (end > MB_CTR_TC_LEARN)
+	{
+		timebase_set_learning(1 == reg_data->data[MB_CTR_TC_LEARN - offset]);
+	}
+
+	return true;
+}
+
+
+/// Helpers
+
+// Split a 32-bit value across two registers, most significant word first.
+static void
+mb_pack_u32 (uint16_t* regs, uint32_t value)
+{
+	regs[0] = (uint16_t)(value >> 16);
+	regs[1] = (uint16_t)(value & 0xFFFF);
+}
+
+// Join a 32-bit value from two registers, most significant word first.
+static uint32_t
+mb_unpack_u32 (const uint16_t* regs)
+{
+	return ((uint32_t)regs[0] << 16) | (uint32_t)regs[1];
+}
+
+// Split an IEEE 754 double across four registers, most significant word first.
+static void
+mb_pack_double (uint16_t* regs, double value)
+{
+	union
+	{
+		double d;
+		uint64_t u;
+	}
+	conv = { .d = value };
+	unsigned int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		regs[i] = (uint16_t)(conv.u >> (48 - (i * 16)));
+	}
+}
+
+// Join an IEEE 754 double from four registers, most significant word first.
+static double
+mb_unpack_double (const uint16_t* regs)
+{
+	union
+	{
+		double d;
+		uint64_t u;
+	}
+	conv = { .u = 0 };
+	unsigned int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		conv.u = (conv.u << 16) | regs[i];
+	}
+
+	return conv.d;
+}
+
+// Counter channel of a register in the counter blocks.
+static counter_channel_t
+mb_counter_channel (uint16_t address)
+{
+	return (counter_channel_t)((address - MB_COUNTER_BASE) / MB_COUNTER_REGS);
+}
+
+// Offset of a register in the counter blocks from the base of its channel's.
+static uint16_t
+mb_counter_offset (uint16_t address)
+{
+	return (address - MB_COUNTER_BASE) % MB_COUNTER_REGS;
+}
@@ -98,10 +98,10 @@ extern "C" {
 #define SYS_CONSOLE_INDEX_0                       0
 
 /* RX buffer size has one additional element for the empty spot needed in circular buffer */
-#define SYS_CONSOLE_USB_CDC_RD_BUFFER_SIZE_IDX0    129
+#define SYS_CONSOLE_USB_CDC_RD_BUFFER_SIZE_IDX0    513
 
 /* TX buffer size has one additional element for the empty spot needed in circular buffer */
-#define SYS_CONSOLE_USB_CDC_WR_BUFFER_SIZE_IDX0    129
+#define SYS_CONSOLE_USB_CDC_WR_BUFFER_SIZE_IDX0    513
 
 
 
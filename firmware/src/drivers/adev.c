@@ -0,0 +1,163 @@
+/*
+ * Incremental Allan Deviation
+ *
+ * @file
+ *   adev.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Overlapping Allan deviation of a stream of contiguous fractional
+ *   frequency samples, at octave-spaced averaging times of 1 to 1024 samples.
+ *   Runs in fixed memory: phase is integrated from the samples and fed
+ *   through a cascade of decimated history rings, one per octave beyond
+ *   ADEV_OVERLAP samples. Averaging times up to ADEV_OVERLAP samples are
+ *   fully overlapping, longer ones are overlapped ADEV_OVERLAP times.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "adev.h"
+
+
+static void stage_push (adev_t* adev, unsigned int stage, double x);
+static void stage_accumulate (adev_t* adev, unsigned int level, unsigned int stage, unsigned int lag);
+
+
+void
+adev_reset (adev_t* adev)
+{
+	unsigned int i;
+
+	adev->tau0 = 0.0;
+	adev->samples = 0;
+	adev->_phase = 0.0;
+
+	for (i = 0; i < ADEV_LEVELS; i++)
+	{
+		adev->_sum_sq[i] = 0.0;
+		adev->_terms[i] = 0;
+	}
+
+	// Every stage starts from the same zero phase point.
+	for (i = 0; i < ADEV_STAGES; i++)
+	{
+		adev->_stage[i].head = 0;
+		adev->_stage[i].count = 0;
+		stage_push(adev, i, 0.0);
+	}
+}
+
+void
+adev_add (adev_t* adev, double y, double tau)
+{
+	unsigned int stage;
+
+	adev->samples++;
+	adev->tau0 += (tau - adev->tau0) / (double)(adev->samples);
+
+	// Phase in units of tau0 is the running sum of fractional frequency.
+	adev->_phase += y;
+
+	// Stage s sees every 2^s-th phase point. Phase needs no filtering before
+	// decimation, so subsampling is exact.
+	for (stage = 0; stage < ADEV_STAGES; stage++)
+	{
+		if (0 != (adev->samples & ((1UL << stage) - 1)))
+		{
+			break;
+		}
+
+		stage_push(adev, stage, adev->_phase);
+	}
+}
+
+double
+adev_get (const adev_t* adev, unsigned int level)
+{
+	double m;
+
+	if ((level >= ADEV_LEVELS) || (0 == adev->_terms[level]))
+	{
+		return 0.0;
+	}
+
+	// AVAR(m tau0) = < (x[i + 2m] - 2x[i + m] + x[i])^2 > / (2 m^2 tau0^2),
+	// with x already in units of tau0.
+	m = (double)(1UL << level);
+
+	return sqrt(adev->_sum_sq[level] / (double)(adev->_terms[level]) / (2.0 * m * m));
+}
+
+uint32_t
+adev_terms (const adev_t* adev, unsigned int level)
+{
+	if (level >= ADEV_LEVELS)
+	{
+		return 0;
+	}
+
+	return adev->_terms[level];
+}
+
+
+static void
+stage_push (adev_t* adev, unsigned int stage, double x)
+{
+	adev_stage_t* st = &(adev->_stage[stage]);
+	unsigned int level;
+
+	st->x[st->head] = x;
+	st->head++;
+
+	if (st->head >= ADEV_HIST_LEN)
+	{
+		st->head = 0;
+	}
+
+	if (st->count < UINT32_MAX)
+	{
+		st->count++;
+	}
+
+	if (0 == stage)
+	{
+		// Undecimated stage serves every tau up to the overlap factor.
+		for (level = 0; level <= ADEV_OVERLAP_LOG2; level++)
+		{
+			stage_accumulate(adev, level, stage, 1U << level);
+		}
+	}
+	else
+	{
+		stage_accumulate(adev, stage + ADEV_OVERLAP_LOG2, stage, ADEV_OVERLAP);
+	}
+}
+
+static void
+stage_accumulate (adev_t* adev, unsigned int level, unsigned int stage, unsigned int lag)
+{
+	adev_stage_t* st = &(adev->_stage[stage]);
+	unsigned int i0, i1, i2;
+	double d2;
+
+	if (st->count <= (2 * lag))
+	{
+		// Not enough history for a second difference yet.
+		return;
+	}
+
+	// Newest sample and the ones lag and 2 * lag before it.
+	i0 = (st->head + ADEV_HIST_LEN - 1) % ADEV_HIST_LEN;
+	i1 = (st->head + ADEV_HIST_LEN - 1 - lag) % ADEV_HIST_LEN;
+	i2 = (st->head + ADEV_HIST_LEN - 1 - (2 * lag)) % ADEV_HIST_LEN;
+
+	d2 = st->x[i0] - (2.0 * st->x[i1]) + st->x[i2];
+	adev->_sum_sq[level] += d2 * d2;
+	adev->_terms[level]++;
+}
@@ -0,0 +1,78 @@
+/*
+ * Incremental Allan Deviation
+ *
+ * @file
+ *   adev.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Overlapping Allan deviation of a stream of contiguous fractional
+ *   frequency samples, at octave-spaced averaging times of 1 to 1024 samples.
+ *   Runs in fixed memory: phase is integrated from the samples and fed
+ *   through a cascade of decimated history rings, one per octave beyond
+ *   ADEV_OVERLAP samples. Averaging times up to ADEV_OVERLAP samples are
+ *   fully overlapping, longer ones are overlapped ADEV_OVERLAP times.
+ */
+
+#ifndef ADEV_H
+#define ADEV_H
+
+
+#include <stdint.h>
+
+
+#define ADEV_LEVELS (11U)  // tau = 1, 2, 4 ... 1024 samples
+#define ADEV_OVERLAP_LOG2 (3U)
+#define ADEV_OVERLAP (1U << ADEV_OVERLAP_LOG2)
+#define ADEV_STAGES (ADEV_LEVELS - ADEV_OVERLAP_LOG2)
+#define ADEV_HIST_LEN ((2U * ADEV_OVERLAP) + 1U)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct
+{
+	double x[ADEV_HIST_LEN];  // phase history, in units of tau0
+	unsigned int head;  // next slot to be written
+	uint32_t count;  // samples pushed, saturating
+}
+adev_stage_t;
+
+typedef struct
+{
+	double tau0;  // mean sample interval in seconds
+	uint32_t samples;
+	double _phase;
+	double _sum_sq[ADEV_LEVELS];
+	uint32_t _terms[ADEV_LEVELS];
+	adev_stage_t _stage[ADEV_STAGES];
+}
+adev_t;
+
+
+void adev_reset (adev_t* adev);
+void adev_add (adev_t* adev, double y, double tau);  // y fractional frequency over tau seconds
+
+double adev_get (const adev_t* adev, unsigned int level);  // zero if no data yet
+uint32_t adev_terms (const adev_t* adev, unsigned int level);
+
+static inline double
+adev_tau (const adev_t* adev, unsigned int level)
+{
+	return adev->tau0 * (double)(1UL << level);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ADEV_H */
@@ -11,18 +11,56 @@
  *   Copyright 2021 Frequencer Team
  *
  * @brief
- *   Automatic wide-range frequency counter for the signal on T1CK.
+ *   Automatic wide-range frequency counter for the signal on T1CK. The same
+ *   pin is mapped to T2CK and IC3, so a 32-bit Timer2/3 pair or hardware
+ *   input capture can stand in for the 16-bit Timer1 as the counting backend.
+ *   In ratio mode Timer2/3 instead counts a second input over the same gates.
+ *   A second channel counts PIC_X1 on a 32-bit Timer6/7 pair at the same
+ *   time, with its own state machine and autoranging. Period and pulse modes
+ *   time single cycles of the T1CK signal with IC3 instead of counting. All
+ *   register access is in counter_hw.c.
  */
 
-#include <definitions.h>
 #include <math.h>
 #include <stdio.h>
+#include "adev.h"
+#include "counter_hw.h"
 #include "hang_here.h"
+#include "kalman.h"
+#include "stats.h"
 #include "sw_timer.h"
+#include "timebase.h"
 
 #include "counter.h"
 
-#define FH_LEN (5000U)
+// Must be a power of two.
+#define TS_RING_LEN (32U)
+
+// Fraction of the timeout the autoranging sizes each gate to fill.
+#define GATE_TARGET (0.7)
+
+// Overflows per gate used by the least-squares estimator, at minimum.
+#define LSQ_POINTS_MIN (16U)
+
+// Overflows per fixed gate the autoranging aims for, at minimum. Each gate
+// spans whole overflows, so it can fall up to one overflow short of the gate
+// time - more overflows per gate keep that shortfall small.
+#define FIXED_GATE_POINTS (8U)
+
+// Default RMS noise on each gate timestamp, which sets the Kalman filter's
+// trust in each result. Timer overflows are timestamped by their ISR, so carry
+// its latency spread as well as core timer quantisation. IC3 timestamps in
+// hardware, so only quantisation is left.
+#define KF_TS_NOISE_ISR (1e-6)  // s
+#define KF_TS_NOISE_CAPTURE (50e-9)  // s
+
+// Fastest input the capture backend takes. IC3 interrupts with one capture
+// slot of its FIFO to spare, which at this rate is 8 us of ISR latency. Faster
+// inputs fall back to Timer1.
+#define CAPTURE_HZ_MAX (2e6)
+
+// Raw result records kept for the host. Must be a power of two.
+#define RAW_RING_LEN (128U)
 
 
 typedef enum
@@ -36,101 +74,281 @@ typedef enum
 state_t;
 
 
-static sw_timer_t timeout, dbg_timer;
-static uint32_t ct_start, ct_stop, timeout_tmr1;
-static double frequency;
-static double freq_history[FH_LEN];
-static unsigned int fh_index, n_avg, n_cur;
-static state_t state;
+// All of one channel's measurement. Each channel runs its own state machine
+// and autoranging on its own timer, so channels count concurrently.
+typedef struct
+{
+	const char* name;
+	counter_backend_t backend;
+	sw_timer_t timeout, dbg_timer, overrun_timer;
+	uint32_t ct_start, ct_stop, ct_last;
+	double timeout_counts;
+	uint32_t timeout_ms;
+	double frequency;
+	stats_t freq_stats;
+	adev_t freq_adev;
+	double adev_f0;
+	bool adev_restart;
+	kalman_t freq_kf;
+	bool kf_enabled;
+	uint32_t kf_last;
+	double kf_ts_noise;  // s, zero for the backend's default
+	unsigned int n_avg, n_avg_min, n_cur;
+	state_t state;
+	bool continuous;
+	counter_estimator_t estimator;
+
+	// Fixed gate mode, if fixed_gate_ms is non-zero. Each gate closes on its
+	// last overflow before gate_end, which then steps on by exactly
+	// fixed_gate_ticks.
+	uint32_t fixed_gate_ms, fixed_gate_ticks, gate_end;
+	unsigned int n_fixed;
+	uint32_t result_ticks;
+
+	// Ratio mode, REF channel only. Timer2/3 free-runs on the B input, and
+	// its count is sampled with every Timer1 overflow, so b_stop - b_start is
+	// B edges over the gate.
+	bool ratio_mode;
+	uint32_t b_start, b_stop, b_last;
+	double ratio;
+
+	// Period and pulse modes, REF channel only. IC3 timestamps single edges,
+	// so each input cycle gives a result. pulse_edges counts captures since
+	// IC3 restarted, so in pulse mode even ones are rising and odd falling.
+	counter_mode_t mode;
+	uint32_t pulse_rise, pulse_fall;
+	unsigned int pulse_edges;
+	double period_s, width_s, duty;
+
+	// Least-squares running sums over the gate in progress. Overflow k of the
+	// gate happened dt_k core timer ticks after ct_start.
+	double lsq_sum_t, lsq_sum_kt;
+
+	// Single-producer (ISR), single-consumer (task) ring of overflow or
+	// capture timestamps. The ISR only ever writes ts_head and ts_dropped,
+	// the task only ever writes ts_tail, so no locking is needed. ts_aux
+	// holds the ratio mode B count alongside each timestamp.
+	volatile uint32_t ts_ring[TS_RING_LEN];
+	volatile uint32_t ts_aux[TS_RING_LEN];
+	volatile unsigned int ts_head, ts_tail, ts_dropped;
+	unsigned int ts_dropped_seen;
+	unsigned int overruns;  // since last reported
+}
+channel_t;
+
+
+static channel_t channels[COUNTER_CHANNELS];
 
+// Raw result records, oldest overwritten when full. Only ever touched from
+// task context, so unlike ts_ring it needs no care over ordering.
+static counter_raw_t raw_ring[RAW_RING_LEN];
+static unsigned int raw_head, raw_tail;
+static uint32_t raw_seq;
+
+
+static void
+channel_init (channel_t* ch, const char* name, counter_backend_t backend)
+{
+	ch->name = name;
+	ch->timeout = SW_TIMER(100);
+	ch->dbg_timer = SW_TIMER(1000);
+	sw_timer_reset(&ch->dbg_timer);
+	ch->overrun_timer = SW_TIMER(1000);
+	sw_timer_reset(&ch->overrun_timer);
+
+	ch->ct_start = 0;
+	ch->ct_stop = 0;
+	ch->ct_last = 0;
+	ch->frequency = 0.0;
+	ch->continuous = true;
+	ch->estimator = CE_RECIPROCAL;
+	ch->backend = backend;
+	ch->fixed_gate_ms = 0;
+	ch->fixed_gate_ticks = 0;
+	ch->gate_end = 0;
+	ch->n_fixed = FIXED_GATE_POINTS;
+	ch->result_ticks = 0;
+	ch->ratio_mode = false;
+	ch->b_start = 0;
+	ch->b_stop = 0;
+	ch->b_last = 0;
+	ch->ratio = 0.0;
+	ch->mode = CM_FREQUENCY;
+	ch->pulse_rise = 0;
+	ch->pulse_fall = 0;
+	ch->pulse_edges = 0;
+	ch->period_s = 0.0;
+	ch->width_s = 0.0;
+	ch->duty = 0.0;
+	ch->state = CS_INIT;
+	ch->n_avg = 1;
+	ch->n_avg_min = 1;
+	ch->n_cur = 0;
+	ch->lsq_sum_t = 0.0;
+	ch->lsq_sum_kt = 0.0;
+	ch->ts_head = 0;
+	ch->ts_tail = 0;
+	ch->ts_dropped = 0;
+	ch->ts_dropped_seen = 0;
+	ch->overruns = 0;
+	stats_reset(&ch->freq_stats);
+	adev_reset(&ch->freq_adev);
+	ch->adev_f0 = 0.0;
+	ch->adev_restart = true;
+	kalman_reset(&ch->freq_kf);
+	kalman_set_noise(&ch->freq_kf, KF_Q_FREQ_DEFAULT, KF_Q_DRIFT_DEFAULT);
+	ch->kf_enabled = false;
+	ch->kf_last = 0;
+	ch->kf_ts_noise = 0.0;
+}
 
 void
 counter_init (void)
 {
-	timeout = SW_TIMER(100);
-	dbg_timer = SW_TIMER(1000);
-	sw_timer_reset(&dbg_timer);
+	raw_head = 0;
+	raw_tail = 0;
+	raw_seq = 0;
+	channel_init(&channels[CC_REF], "REF", CB_TIMER1);
+	channel_init(&channels[CC_X1], "X1", CB_TIMER67);
+	counter_hw_init();
+}
+
+// Counting timer of the channel's backend.
+
+static inline uint32_t
+tmr_period (channel_t* ch)
+{
+	return counter_hw_period(ch->backend);
+}
+
+static inline uint32_t
+tmr_period_min (channel_t* ch)
+{
+	return counter_hw_period_min(ch->backend);
+}
+
+static inline uint32_t
+tmr_period_max (channel_t* ch)
+{
+	return counter_hw_period_max(ch->backend);
+}
 
-	ct_start = 0;
-	ct_stop = 0;
-	frequency = 0.0;
-	state = CS_INIT;
-	fh_index = 0;
-	n_avg = 1;
-	n_cur = 0;
+static inline uint32_t
+tmr_count (channel_t* ch)
+{
+	return counter_hw_count(ch->backend);
+}
 
-	PMD4bits.T1MD = 0;
-	T1CONbits.ON = 0;
-	_nop();
+static inline void
+tmr_clear (channel_t* ch)
+{
+	counter_hw_clear(ch->backend);
+}
 
-	T1CONbits.SIDL = 0;
-	T1CONbits.TWDIS = 1;
-	T1CONbits.TGATE = 0;
-	T1CONbits.TCKPS = 0b00;
-	T1CONbits.TSYNC = 0;
-	T1CONbits.TCS = 1;
-	TMR1 = 0;
+static inline void
+tmr_set_period (channel_t* ch, uint32_t period)
+{
+	counter_hw_set_period(ch->backend, period);
+}
 
-	IPC1bits.T1IP = 7;
-	IPC1bits.T1IS = 0;
-	IFS0bits.T1IF = 0;
-	IEC0bits.T1IE = 0;
+static inline unsigned int
+tmr_prescale (channel_t* ch)
+{
+	return counter_hw_prescale(ch->backend);
+}
 
-	T1CONbits.ON = 1;
+static inline unsigned int
+tmr_prescale_max (channel_t* ch)
+{
+	return counter_hw_prescale_max(ch->backend);
+}
+
+static inline void
+tmr_set_prescale (channel_t* ch, unsigned int prescale)
+{
+	counter_hw_set_prescale(ch->backend, prescale);
 }
 
-static unsigned int
-timer1_prescale (void)
+static inline void
+tmr_irq_enable (channel_t* ch, bool enable)
 {
-	switch (T1CONbits.TCKPS)
+	counter_hw_irq_enable(ch->backend, enable);
+}
+
+static inline void
+tmr_irq_clear (channel_t* ch)
+{
+	counter_hw_irq_clear(ch->backend);
+}
+
+static inline float
+gate_progress (channel_t* ch)
+{
+	// 0.0 to 1.0 (0-100%) of the timeout used by the last complete gate.
+	// Taken from the captured timestamps, as in continuous mode the timeout
+	// timer has already been restarted for the next gate.
+	return (float)(ch->ct_stop - ch->ct_start) / (float)SWT_MS_TICKS(ch->timeout.length);
+}
+
+static inline bool
+gate_filled (channel_t* ch)
+{
+	// The last complete gate took over 45% of the timeout, compared exactly
+	// in ticks.
+	return ((uint64_t)(ch->ct_stop - ch->ct_start) * 20) > (SWT_MS_TICKS(ch->timeout.length) * 9);
+}
+
+static inline double
+kf_ts_noise (channel_t* ch)
+{
+	if (ch->kf_ts_noise > 0.0)
 	{
-		case 0b00:
-		{
-			return 1;
-		}
+		return ch->kf_ts_noise;
+	}
 
-		/*
-		 * case 0b01:
-		 * {
-		 *  return 8;
-		 * }
-		 *
-		 * case 0b10:
-		 * {
-		 *  return 64;
-		 * }
-		 *
-		 * case 0b11:
-		 * {
-		 *  return 256;
-		 * }
-		 */
+	return (CB_CAPTURE == ch->backend) ? KF_TS_NOISE_CAPTURE : KF_TS_NOISE_ISR;
+}
 
-		default:
-		{
-			HANG_HERE();
-		}
+static inline bool
+ts_ring_peek (channel_t* ch, uint32_t* ticks, uint32_t* aux)
+{
+	unsigned int tail = ch->ts_tail;
+
+	if (tail == ch->ts_head)
+	{
+		return false;
 	}
+
+	*ticks = ch->ts_ring[tail & (TS_RING_LEN - 1)];
+	*aux = ch->ts_aux[tail & (TS_RING_LEN - 1)];
+
+	return true;
 }
 
-static inline float
-timeout_progress (void)
+static inline void
+ts_ring_drop (channel_t* ch)
 {
-	// 0.0 to 1.0 (0-100%)
-	return (float)(sw_timer_elapsed(&timeout)) / (float)(timeout.length);
+	ch->ts_tail = ch->ts_tail + 1;
+}
+
+static inline void
+ts_ring_flush (channel_t* ch)
+{
+	ch->ts_tail = ch->ts_head;
+	ch->ts_dropped_seen = ch->ts_dropped;
 }
 
 static void
-debug_report (bool now)
+debug_report (channel_t* ch, bool now)
 {
 	// Print periodic message detailing current settings and frequency measured.
-	if (sw_timer_expired(&dbg_timer) || now)
+	if (sw_timer_expired(&ch->dbg_timer) || now)
 	{
 		int dec_digits = 1;
 
-		if (frequency > 0.0)
+		if (ch->frequency > 0.0)
 		{
-			dec_digits = 8 - (int)floor(log10(frequency));
+			dec_digits = 8 - (int)floor(log10(ch->frequency));
 
 			if (dec_digits < 0)
 			{
@@ -144,168 +362,559 @@ debug_report (bool now)
 		}
 
 		printf(
-			"Counter: %10.*f Hz, PR1 = %5d, TO = %4dms, N = %2d\n",
+			"Counter %s: %10.*f Hz, PS = %3d, PR = %5u, TO = %4dms, N = %2d\n",
+			ch->name,
 			dec_digits,
-			frequency,
-			PR1,
-			timeout.length,
-			n_avg
+			ch->frequency,
+			tmr_prescale(ch),
+			tmr_period(ch),
+			ch->timeout.length,
+			ch->n_avg
 		);
-		sw_timer_reset(&dbg_timer);
+		sw_timer_reset(&ch->dbg_timer);
 	}
 }
 
 static void
-update_frequency (void)
+overrun_report (channel_t* ch)
+{
+	// Once the input outpaces the task, every pass overruns. Report how many
+	// there were at most once a period, as debug_report() does.
+	if ((ch->overruns > 0) && sw_timer_expired(&ch->overrun_timer))
+	{
+		printf("Counter %s: Timestamp ring overruns: %u.\n", ch->name, ch->overruns);
+		ch->overruns = 0;
+		sw_timer_reset(&ch->overrun_timer);
+	}
+}
+
+static inline void
+lsq_reset (channel_t* ch)
+{
+	ch->lsq_sum_t = 0.0;
+	ch->lsq_sum_kt = 0.0;
+}
+
+static inline void
+lsq_add (channel_t* ch, unsigned int k, uint32_t ticks)
+{
+	// Unsigned subtraction is correct across a core timer rollover.
+	double dt = (double)(ticks - ch->ct_start);
+
+	ch->lsq_sum_t += dt;
+	ch->lsq_sum_kt += (double)k * dt;
+}
+
+static double
+lsq_period_ns (channel_t* ch)
+{
+	// Slope of the least-squares line through (k, dt_k) for k = 0..n, which
+	// is the mean overflow period. As k is evenly spaced, the sums over k are
+	// closed form: mean(k) = n/2 and sum((k - n/2)^2) = n(n+1)(n+2)/12.
+	double n = (double)ch->n_avg;
+	double sxx = (n * (n + 1.0) * (n + 2.0)) / 12.0;
+	double sxy = ch->lsq_sum_kt - ((n / 2.0) * ch->lsq_sum_t);
+
+	return sw_timer_ticks_ns(sxy / sxx);
+}
+
+static void
+raw_add (channel_t* ch, uint32_t start, uint32_t stop, uint32_t period, unsigned int prescale, unsigned int n)
+{
+	counter_raw_t* rec = &raw_ring[raw_head & (RAW_RING_LEN - 1)];
+
+	rec->seq = raw_seq++;
+	rec->ct_start = start;
+	rec->ct_stop = stop;
+	rec->period = period;
+	rec->prescale = (uint16_t)prescale;
+	rec->n = n;
+	rec->channel = (uint16_t)(ch - channels);
+
+	raw_head++;
+
+	if ((raw_head - raw_tail) > RAW_RING_LEN)
+	{
+		// The host has fallen behind. The sequence gap shows it.
+		raw_tail = raw_head - RAW_RING_LEN;
+	}
+}
+
+static void
+update_frequency (channel_t* ch)
 {
 	// Use current timestamps and timer settings to calculate input signal
 	// frequency and update module data.
 
-	double edges = (double)(PR1 * timer1_prescale());
-	double time = ns_time_delta(ct_start, ct_stop) / 1000000000.0;
+	double edges = (double)tmr_period(ch);
+
+	// Correct the timebase for the die temperature over this gate.
+	timebase_compensate();
 
 	// There seem to be large inaccuracies in the math if this
 	// operation is performed when declaring/assigning the variable.
 	edges += 1.0;
-	frequency = (edges * (double)n_avg) / time;
+	edges *= (double)tmr_prescale(ch);
+
+	switch (ch->estimator)
+	{
+		case CE_LEAST_SQUARES:
+		{
+			// Regression over every overflow in the gate. Over n overflows
+			// its noise is sqrt(6n / ((n + 1)(n + 2))) of the reciprocal
+			// estimate's, so 0.56 at LSQ_POINTS_MIN. The autoranging holds
+			// n as the gate grows, so like it, noise falls as 1/tau.
+			ch->frequency = edges / (lsq_period_ns(ch) / 1000000000.0);
+
+			break;
+		}
+
+		case CE_RECIPROCAL:
+		default:
+		{
+			// First and last overflow of the gate only.
+			double time = sw_timer_ticks_s(ch->ct_stop - ch->ct_start);
+
+			ch->frequency = (edges * (double)ch->n_avg) / time;
+
+			break;
+		}
+	}
 
-	freq_history[fh_index] = frequency;
-	fh_index++;
+	// Both inputs were counted between the same two Timer1 overflows, so the
+	// core timer drops out of the ratio. Unsigned subtraction is correct
+	// across a Timer2/3 rollover.
+	if (ch->ratio_mode && (ch->b_stop != ch->b_start))
+	{
+		ch->ratio = (edges * (double)ch->n_avg) / (double)(ch->b_stop - ch->b_start);
+	}
 
-	if (fh_index >= FH_LEN)
+	ch->result_ticks = ch->ct_stop;
+	raw_add(ch, ch->ct_start, ch->ct_stop, tmr_period(ch), tmr_prescale(ch), ch->n_avg);
+	stats_add(&ch->freq_stats, ch->frequency);
+
+	// Only REF_PIC carries the timebase reference.
+	if (&channels[CC_REF] == ch)
 	{
-		fh_index = 0;
+		timebase_update(ch->frequency);
 	}
 
-	debug_report(false);
+	if (ch->kf_enabled)
+	{
+		// Both ends of the gate carry timestamp noise. Results are spaced by
+		// their end timestamps, so dead time between gates is accounted for.
+		double gate_s = sw_timer_ticks_s(ch->ct_stop - ch->ct_start);
+		double sd = (ch->frequency * kf_ts_noise(ch) * sqrt(2.0)) / gate_s;
+		double dt = 0.0;
+
+		if (ch->freq_kf.samples > 0)
+		{
+			dt = sw_timer_ticks_s(ch->ct_stop - ch->kf_last);
+		}
+
+		kalman_add(&ch->freq_kf, ch->frequency, sd * sd, dt);
+		ch->kf_last = ch->ct_stop;
+	}
+
+	// Allan deviation is only meaningful over contiguous gates of the same
+	// settings, so it starts over whenever the measurement was restarted.
+	if (ch->adev_restart)
+	{
+		adev_reset(&ch->freq_adev);
+		ch->adev_f0 = ch->frequency;
+		ch->adev_restart = false;
+	}
+
+	adev_add(
+		&ch->freq_adev,
+		(ch->frequency / ch->adev_f0) - 1.0,
+		sw_timer_ticks_s(ch->ct_stop - ch->ct_start)
+	);
+
+	debug_report(ch, false);
+}
+
+static inline uint32_t
+timeout_min (channel_t* ch)
+{
+	// A fixed gate always needs its gate time on top.
+	return ch->fixed_gate_ms + TIMEOUT_MIN;
+}
+
+static inline uint32_t
+timeout_max (channel_t* ch)
+{
+	return ch->fixed_gate_ms + TIMEOUT_MAX;
 }
 
 static void
-handle_interval_too_short (void)
+autorange (channel_t* ch, double freq_est)
 {
-	// Adjust timer settings to account for timer events happening too often.
-	if (timeout.length > TIMEOUT_MIN)
+	// Choose prescaler, period, n_avg and timeout directly from a frequency
+	// estimate, so that the next gate fills GATE_TARGET of its timeout. The 45%
+	// to 100% acceptance window then tolerates an estimate that is 35% low or
+	// 55% high, so one estimate is enough to converge. A fixed gate instead
+	// spreads FIXED_GATE_POINTS overflows over the gate time.
+	double gate_s = GATE_TARGET * (double)TIMEOUT_MIN / 1000.0;
+	double counts, gate_ms, counts_max, timeout_est;
+	unsigned int n = ch->n_avg_min;
+	unsigned int prescale = 1;
+	uint32_t pr_new, timeout_new;
+
+	if ((CB_CAPTURE == ch->backend) && (freq_est > CAPTURE_HZ_MAX))
+	{
+		// IC3 would overflow its FIFO or the ring. The caller starts over,
+		// which enables Timer1 in its place.
+		printf("Counter %s: Input too fast for capture, using Timer1.\n", ch->name);
+		tmr_irq_enable(ch, false);
+		ch->backend = CB_TIMER1;
+	}
+
+	if (ch->fixed_gate_ms > 0)
+	{
+		gate_s = (double)ch->fixed_gate_ms / 1000.0;
+
+		if (n < FIXED_GATE_POINTS)
+		{
+			n = FIXED_GATE_POINTS;
+		}
+	}
+
+	double edges = freq_est * gate_s;
+
+	// Use the smallest prescaler that fits the gate into n_avg_min overflows.
+	// The edge count stays exact, as every overflow is (PR + 1) * prescale
+	// input edges, but the interrupt rate drops by up to 256 times.
+	double pr_max = (double)tmr_period_max(ch);
+
+	while ((prescale < tmr_prescale_max(ch)) && ((edges / (double)n) > ((pr_max + 1.0) * (double)prescale)))
 	{
-		// First stage - reduce timeout.
-		uint32_t timeout_new = timeout.length / 2;
+		prescale *= 8;
 
-		if (timeout_new < TIMEOUT_MIN)
+		if (prescale > 64)
 		{
-			timeout_new = TIMEOUT_MIN;
+			prescale = 256;
 		}
+	}
+
+	counts = edges / (double)prescale;
 
-		timeout.length = timeout_new;
+	if ((counts / (double)n) > (pr_max + 1.0))
+	{
+		// Fast signal - even the largest prescaler can't stretch the gate far
+		// enough.
+		n = (unsigned int)ceil(counts / (pr_max + 1.0));
 	}
-	else if (PR1 < PR1_MAX)
+
+	if ((counts / (double)n) > pr_max)
 	{
-		// Second stage - increase timer overflow setpoint by timeout ratio.
-		uint32_t pr1_new = PR1 * (1.0 / timeout_progress());
+		pr_new = (uint32_t)(pr_max + 1.0);
+	}
+	else
+	{
+		pr_new = (uint32_t)floor((counts / (double)n) + 0.5);
+	}
+
+	if (pr_new > 0)
+	{
+		pr_new -= 1;
+	}
 
-		if (pr1_new > PR1_MAX)
+	if (pr_new < tmr_period_min(ch))
+	{
+		pr_new = tmr_period_min(ch);
+	}
+
+	if (ch->fixed_gate_ms > 0)
+	{
+		// The gate time is set, so n is only the overflows expected in it. The
+		// gate closes on the first overflow after it, so allow two more.
+		gate_ms = (2.0 * ((double)pr_new + 1.0) * (double)prescale * 1000.0) / freq_est;
+		timeout_est = (double)ch->fixed_gate_ms + gate_ms;
+		ch->n_fixed = n;
+	}
+	else
+	{
+		// Slow signal - period is at minimum, so give up overflows per gate
+		// before giving up more time than TIMEOUT_MAX allows.
+		counts_max = (freq_est * (GATE_TARGET * (double)TIMEOUT_MAX / 1000.0)) / (double)prescale;
+
+		while ((n > 1) && (((double)n * ((double)pr_new + 1.0)) > counts_max))
 		{
-			pr1_new = PR1_MAX;
+			n /= 2;
 		}
 
-		PR1 = pr1_new;
+		// Longest timeout needed for this gate.
+		gate_ms = ((double)n * ((double)pr_new + 1.0) * (double)prescale * 1000.0) / freq_est;
+		timeout_est = gate_ms / GATE_TARGET;
+	}
+
+	// Clamp before converting, as a slow signal can ask for any length.
+	if (timeout_est < (double)timeout_min(ch))
+	{
+		timeout_new = timeout_min(ch);
+	}
+	else if (timeout_est > (double)timeout_max(ch))
+	{
+		timeout_new = timeout_max(ch);
 	}
 	else
 	{
-		// Third stage - double averaging count.
-		n_avg *= 2;
+		timeout_new = (uint32_t)ceil(timeout_est);
 	}
 
+	tmr_set_prescale(ch, prescale);
+	tmr_set_period(ch, pr_new);
+
+	ch->n_avg = n;
+	ch->timeout.length = timeout_new;
+}
+
+static void
+handle_interval_too_short (channel_t* ch)
+{
+	// Adjust timer settings to account for timer events happening too often.
+	// The completed gate gives a full-resolution estimate to range from.
+	double edges = ((double)tmr_period(ch) + 1.0) * (double)tmr_prescale(ch);
+
+	autorange(ch, (edges * (double)ch->n_avg) / (sw_timer_ticks_s(ch->ct_stop - ch->ct_start)));
+
 	// There's no signal too fast!
-	// TODO: Monitor die temperature.
 }
 
 static void
-handle_interval_too_long (void)
+handle_interval_too_long (channel_t* ch)
 {
 	// Adjust timer settings to account for timer events being too infrequent.
-	if (n_avg > 1)
+	// Range from the edges counted so far, if any.
+	if (ch->timeout_counts > 0)
 	{
-		// First stage - reduce averaging count by half.
-		n_avg /= 2;
+		double edges = ch->timeout_counts * (double)tmr_prescale(ch);
+
+		autorange(ch, (edges * 1000.0) / (double)ch->timeout_ms);
 	}
-	else if (PR1 > PR1_MIN)
+	else if (ch->timeout.length < timeout_max(ch))
 	{
-		// Second stage - reduce timer overflow setpoint by timer fill ratio.
-		// Reduced further by 5% for hysteresis.
-		float tmr_progress = (float)timeout_tmr1 / (float)PR1;
-		uint32_t pr1_new = (uint32_t)floor((float)PR1 * tmr_progress * 0.95);
+		// Nothing counted at all - extend timeout and use the shortest gate.
+		uint32_t timeout_new = ch->timeout.length * 3;
 
-		if (pr1_new < PR1_MIN)
+		if (timeout_new > timeout_max(ch))
 		{
-			pr1_new = PR1_MIN;
+			timeout_new = timeout_max(ch);
 		}
 
-		if (pr1_new > PR1_MAX)
-		{
-			pr1_new = PR1_MAX;
-		}
+		ch->timeout.length = timeout_new;
+		ch->n_avg = 1;
+		tmr_set_prescale(ch, 1);
+		tmr_set_period(ch, tmr_period_min(ch));
+	}
+	else
+	{
+		// Signal not present or less than 1Hz - can't measure.
+		ch->frequency = 0.0;
+		printf("Counter %s: No signal detected.\n", ch->name);
+	}
+}
 
-		if (pr1_new != PR1)
-		{
-			PR1 = pr1_new;
-			TMR1 = 0;
-		}
+static bool
+fixed_gate_in_range (channel_t* ch)
+{
+	// Overflows per fixed gate follow the input frequency. Off by more than 2x
+	// is worth a re-range, as is falling short of the estimator's minimum,
+	// unless the period can't go any shorter anyway.
+	if (ch->n_avg > (2 * ch->n_fixed))
+	{
+		return false;
 	}
-	else if (timeout.length < TIMEOUT_MAX)
+
+	if (((2 * ch->n_avg) < ch->n_fixed) || (ch->n_avg < ch->n_avg_min))
 	{
-		// Third stage - extend timeout.
-		uint32_t timeout_new = timeout.length * 3;
+		return (tmr_period(ch) <= tmr_period_min(ch)) && (tmr_prescale(ch) <= 1);
+	}
 
-		if (timeout_new > TIMEOUT_MAX)
-		{
-			timeout_new = TIMEOUT_MAX;
-		}
+	return true;
+}
 
-		timeout.length = timeout_new;
+static inline void
+gate_continue (channel_t* ch)
+{
+	// End of this gate is the start of the next one, and the ISR is still
+	// queueing its overflows - nothing is lost.
+	ch->ct_start = ch->ct_stop;
+	ch->b_start = ch->b_stop;
+	ch->n_cur = 0;
+	lsq_reset(ch);
+	sw_timer_reset(&ch->timeout);
+	ch->state = CS_WAIT_END;
+}
+
+static void
+pulse_result (channel_t* ch, uint32_t rise)
+{
+	// Timer4/5 runs at the core timer rate, so captures convert like core
+	// timer ticks, with the timebase correction applied.
+	timebase_compensate();
+	ch->period_s = sw_timer_ticks_s(rise - ch->pulse_rise);
+
+	if (CM_PULSE == ch->mode)
+	{
+		ch->width_s = sw_timer_ticks_s(ch->pulse_fall - ch->pulse_rise);
+		ch->duty = ch->width_s / ch->period_s;
 	}
-	else
+
+	ch->frequency = 1.0 / ch->period_s;
+	ch->result_ticks = rise;
+
+	// One input edge per result, so period 0, prescale 1 and n 1.
+	raw_add(ch, ch->pulse_rise, rise, 0, 1, 1);
+	stats_add(&ch->freq_stats, ch->frequency);
+
+	if (sw_timer_expired(&ch->dbg_timer))
 	{
-		// Signal not present or less than 1Hz - can't measure.
-		frequency = 0.0;
-		printf("Counter: No signal detected.\n");
+		printf(
+			"Counter %s: T = %.9f s, W = %.9f s, D = %5.2f%%\n",
+			ch->name,
+			ch->period_s,
+			ch->width_s,
+			ch->duty * 100.0
+		);
+		sw_timer_reset(&ch->dbg_timer);
 	}
 }
 
-void
-counter_task (void)
+static void
+pulse_task (channel_t* ch)
 {
-	switch (state)
+	uint32_t ticks, aux;
+
+	if (ch->ts_dropped != ch->ts_dropped_seen)
 	{
-		case CS_CALC:
+		// An edge is missing, and with it which edge is which.
+		printf("Counter %s: Input too fast for %s mode.\n", ch->name, (CM_PERIOD == ch->mode) ? "period" : "pulse");
+		ch->state = CS_INIT;
+	}
+
+	switch (ch->state)
+	{
+		case CS_INIT:
 		{
-			sw_timer_pause(&timeout);
+			counter_hw_irq_enable(CB_CAPTURE, false);
+			counter_hw_set_capture_mode(ch->mode);
+			ts_ring_flush(ch);
+			ch->pulse_edges = 0;
+			ch->timeout.length = PULSE_TIMEOUT;
+			sw_timer_reset(&ch->timeout);
+			ch->state = CS_WAIT_START;
+			counter_hw_irq_clear(CB_CAPTURE);
+			counter_hw_irq_enable(CB_CAPTURE, true);
+
+			break;
+		}
 
-			if (timeout_progress() > 0.45)
+		case CS_WAIT_START:
+		case CS_WAIT_END:
+		{
+			// Each rising edge ends the cycle that the one before it started.
+			// In pulse mode, the falling edge between them ends the pulse.
+			while (ts_ring_peek(ch, &ticks, &aux))
 			{
-				// Timestamp of first and nth timer overflow event established.
-				// Calculate frequency from time delta and edge count.
-				update_frequency();
+				bool rising = (CM_PERIOD == ch->mode) || (0 == (ch->pulse_edges % 2));
+
+				if (!rising)
+				{
+					ch->pulse_fall = ticks;
+				}
+				else
+				{
+					if (CS_WAIT_END == ch->state)
+					{
+						pulse_result(ch, ticks);
+					}
+
+					ch->pulse_rise = ticks;
+					ch->state = CS_WAIT_END;
+				}
+
+				ch->pulse_edges++;
+				sw_timer_reset(&ch->timeout);
+				ts_ring_drop(ch);
 			}
-			else
+
+			if (sw_timer_expired(&ch->timeout))
 			{
-				// Time between overflow events is too short. The calculation
-				// will be inaccurate. Adjust timer settings to compensate.
-				handle_interval_too_short();
-				printf("Counter: Interval too short (%.0f%%).\n", timeout_progress() * 100.0);
-				debug_report(true);
+				// No edge for a whole timeout - the input is stuck, or
+				// slower than any period these modes time.
+				counter_hw_irq_enable(CB_CAPTURE, false);
+				ch->frequency = 0.0;
+				ch->period_s = 0.0;
+				ch->width_s = 0.0;
+				ch->duty = 0.0;
+				printf("Counter %s: No signal detected.\n", ch->name);
+				ch->state = CS_INIT;
 			}
 
-			// Fallthrough to CS_INIT to start next measurement.
-			state = CS_INIT;
+			break;
 		}
 
+		default:
+		{
+			HANG_HERE();
+		}
+	}
+}
+
+static void
+channel_task (channel_t* ch)
+{
+	uint32_t ticks, aux;
+
+	if (CM_FREQUENCY != ch->mode)
+	{
+		pulse_task(ch);
+
+		return;
+	}
+
+	if (ch->ts_dropped != ch->ts_dropped_seen)
+	{
+		// An overflow is missing from the gate in progress, either because
+		// the ISR found the ring full or because IC3's FIFO overflowed before
+		// the ISR ran. Discard the gate and start over. Either way events are
+		// arriving faster than they are taken, so re-range from the span of
+		// the timestamps still queued.
+		unsigned int queued;
+
+		tmr_irq_enable(ch, false);
+		queued = ch->ts_head - ch->ts_tail;
+
+		if (queued > 1)
+		{
+			double edges = (double)(queued - 1) * ((double)tmr_period(ch) + 1.0) * (double)tmr_prescale(ch);
+			uint32_t first = ch->ts_ring[ch->ts_tail & (TS_RING_LEN - 1)];
+			uint32_t last = ch->ts_ring[(ch->ts_head - 1) & (TS_RING_LEN - 1)];
+
+			autorange(ch, edges / (sw_timer_ticks_s(last - first)));
+		}
+
+		ch->overruns++;
+		ch->state = CS_INIT;
+	}
+
+	overrun_report(ch);
+
+	switch (ch->state)
+	{
 		case CS_INIT:
 		{
 			// Initiate counter measurement. This enables the timer interrupt to
 			// capture the time of the first overflow event.
-			sw_timer_reset(&timeout);
-			state = CS_WAIT_START;
-			IFS0bits.T1IF = 0;
-			IEC0bits.T1IE = 1;
+			ts_ring_flush(ch);
+			ch->adev_restart = true;
+			tmr_clear(ch);
+			sw_timer_reset(&ch->timeout);
+			ch->state = CS_WAIT_START;
+			tmr_irq_clear(ch);
+			tmr_irq_enable(ch, true);
 
 			break;
 		}
@@ -313,22 +922,78 @@ counter_task (void)
 		case CS_WAIT_START:
 		case CS_WAIT_END:
 		{
-			if (!sw_timer_expired(&timeout))
+			// Consume overflow timestamps queued by the ISR. After first
+			// overflow event is captured, start time is established. After nth
+			// overflow event is captured, end time and delta are established
+			// and frequency can be calculated.
+			while ((CS_CALC != ch->state) && ts_ring_peek(ch, &ticks, &aux))
+			{
+				if (CS_WAIT_START == ch->state)
+				{
+					ch->ct_start = ticks;
+					ch->b_start = aux;
+					ch->gate_end = ticks + ch->fixed_gate_ticks;
+					ch->n_cur = 0;
+					lsq_reset(ch);
+					sw_timer_reset(&ch->timeout);
+					ch->state = CS_WAIT_END;
+				}
+				else if ((ch->fixed_gate_ms > 0) && (ch->n_cur > 0) && ((int32_t)(ticks - ch->gate_end) >= 0))
+				{
+					// First overflow past the end of a fixed gate. The gate
+					// closes on the overflow before it, and this one is left
+					// queued to open the next gate.
+					ch->ct_stop = ch->ct_last;
+					ch->b_stop = ch->b_last;
+					ch->n_avg = ch->n_cur;
+					ch->gate_end += ch->fixed_gate_ticks;
+					ch->state = CS_CALC;
+
+					break;
+				}
+				else
+				{
+					ch->n_cur++;
+					lsq_add(ch, ch->n_cur, ticks);
+					ch->ct_last = ticks;
+					ch->b_last = aux;
+
+					if ((0 == ch->fixed_gate_ms) && (ch->n_cur >= ch->n_avg))
+					{
+						ch->ct_stop = ticks;
+						ch->b_stop = aux;
+						ch->state = CS_CALC;
+					}
+				}
+
+				ts_ring_drop(ch);
+			}
+
+			if (CS_CALC == ch->state)
 			{
-				// Wait for interrupt to advance state. After first overflow
-				// event is captured, start time is established. After nth
-				// overflow event is captured, end time and delta are
-				// established and frequency can be calculated. The next state
-				// is set by the interrupt.
+				break;
+			}
+
+			if (!sw_timer_expired(&ch->timeout))
+			{
+				// Wait for more overflow events.
 				break;
 			}
 			else
 			{
-				// An overflow event did not occur within the timeout period.
-				// Save TMR1 value to prevent race condition during PR1 adjust.
-				// Fallthrough to CS_TIMED_OUT to adjust settings.
-				timeout_tmr1 = TMR1;
-				state = CS_TIMED_OUT;
+				// The gate did not complete within the timeout period.
+				// Save timer counts to prevent race condition during period
+				// adjust. Fallthrough to CS_TIMED_OUT to adjust settings.
+				tmr_irq_enable(ch, false);
+
+				if (CS_WAIT_START == ch->state)
+				{
+					ch->n_cur = 0;
+				}
+
+				ch->timeout_counts = ((double)ch->n_cur * ((double)tmr_period(ch) + 1.0)) + (double)tmr_count(ch);
+				ch->timeout_ms = sw_timer_elapsed(&ch->timeout);
+				ch->state = CS_TIMED_OUT;
 			}
 		}
 
@@ -336,10 +1001,60 @@ counter_task (void)
 		{
 			// Timed out before the input signal caused a timer overflow. Adjust
 			// settings to compensate for slower input signal.
-			printf("Counter: Interval too long (%d/%d, %d/%d).\n", TMR1, PR1, n_cur, n_avg);
-			handle_interval_too_long();
-			state = CS_INIT;
-			debug_report(true);
+			printf("Counter %s: Interval too long (%u/%u, %d/%d).\n", ch->name, tmr_count(ch), tmr_period(ch), ch->n_cur, ch->n_avg);
+			handle_interval_too_long(ch);
+			ch->state = CS_INIT;
+			debug_report(ch, true);
+
+			break;
+		}
+
+		case CS_CALC:
+		{
+			if (ch->fixed_gate_ms > 0)
+			{
+				// A fixed gate always gives its result, on time. Once the input
+				// has drifted enough to matter, re-range for the next one.
+				update_frequency(ch);
+
+				if (!fixed_gate_in_range(ch))
+				{
+					printf("Counter %s: Gate overflows out of range (%d/%d).\n", ch->name, ch->n_avg, ch->n_fixed);
+					autorange(ch, ch->frequency);
+					debug_report(ch, true);
+				}
+				else if (ch->continuous)
+				{
+					gate_continue(ch);
+
+					break;
+				}
+			}
+			else if (gate_filled(ch))
+			{
+				// Timestamp of first and nth timer overflow event established.
+				// Calculate frequency from time delta and edge count.
+				update_frequency(ch);
+
+				if (ch->continuous)
+				{
+					gate_continue(ch);
+
+					break;
+				}
+			}
+			else
+			{
+				// Time between overflow events is too short. The calculation
+				// will be inaccurate. Adjust timer settings to compensate.
+				handle_interval_too_short(ch);
+				printf("Counter %s: Interval too short (%.0f%%).\n", ch->name, gate_progress(ch) * 100.0);
+				debug_report(ch, true);
+			}
+
+			// Start next measurement from scratch.
+			tmr_irq_enable(ch, false);
+			ch->state = CS_INIT;
 
 			break;
 		}
@@ -349,63 +1064,329 @@ counter_task (void)
 			HANG_HERE();
 		}
 	}
+}
 
-	// printf("Counter: State %d, progress %.0f%%.\n", state, 100.0 * timeout_progress());
+void
+counter_task (void)
+{
+	unsigned int i;
+
+	for (i = 0; i < COUNTER_CHANNELS; i++)
+	{
+		channel_task(&channels[i]);
+	}
 }
 
 
 double
-counter_freq_hz (void)
+counter_freq_hz (counter_channel_t channel)
 {
-	return frequency;
+	return channels[channel].frequency;
 }
 
-static uint32_t ticks_local;
+const stats_t*
+counter_stats (counter_channel_t channel)
+{
+	return &channels[channel].freq_stats;
+}
+
+void
+counter_stats_reset (counter_channel_t channel)
+{
+	stats_reset(&channels[channel].freq_stats);
+}
+
+const adev_t*
+counter_adev (counter_channel_t channel)
+{
+	return &channels[channel].freq_adev;
+}
 
 void
-__ISR (_TIMER_1_VECTOR, ipl7SRS) counter_timer1_isr(void)
+counter_set_kalman (counter_channel_t channel, bool enable)
 {
-	__builtin_disable_interrupts();
-	LED3_Set();
-	ticks_local = __builtin_mfc0(_CP0_COUNT, _CP0_COUNT_SELECT);
-	LED3_Clear();
-	__builtin_enable_interrupts();
+	channel_t* ch = &channels[channel];
 
-	IFS0bits.T1IF = 0;
+	// Start the filter afresh, so it never spans a time it wasn't fed.
+	kalman_reset(&ch->freq_kf);
+	ch->kf_enabled = enable;
+}
 
-	switch (state)
+void
+counter_set_kalman_noise (counter_channel_t channel, double noise_s)
+{
+	channel_t* ch = &channels[channel];
+
+	if (noise_s < 0.0)
 	{
-		case CS_WAIT_START:
-		{
-			ct_start = ticks_local;
-			n_cur = 0;
-			sw_timer_reset(&timeout);
-			state = CS_WAIT_END;
+		noise_s = 0.0;
+	}
 
-			break;
-		}
+	// A new noise changes every gating decision, so start afresh as well.
+	kalman_reset(&ch->freq_kf);
+	ch->kf_ts_noise = noise_s;
+}
 
-		case CS_WAIT_END:
-		{
-			n_cur++;
+double
+counter_kalman_noise (counter_channel_t channel)
+{
+	return kf_ts_noise(&channels[channel]);
+}
 
-			if (n_cur >= n_avg)
-			{
-				n_cur = 0;
-				ct_stop = ticks_local;
-				IEC0bits.T1IE = 0;
-				state = CS_CALC;
-			}
+bool
+counter_kalman_mode (counter_channel_t channel)
+{
+	return channels[channel].kf_enabled;
+}
 
-			break;
-		}
+const kalman_t*
+counter_kalman (counter_channel_t channel)
+{
+	return &channels[channel].freq_kf;
+}
 
-		default:
-		{
-			IEC0bits.T1IE = 0;
-		}
+void
+counter_set_continuous (counter_channel_t channel, bool enable)
+{
+	channel_t* ch = &channels[channel];
+
+	// Abandon the gate in progress and start over in the new mode.
+	tmr_irq_enable(ch, false);
+	ch->continuous = enable;
+	ch->state = CS_INIT;
+}
+
+void
+counter_set_estimator (counter_channel_t channel, counter_estimator_t new_estimator)
+{
+	channel_t* ch = &channels[channel];
+
+	// Abandon the gate in progress and start over with the new estimator. The
+	// regression needs several overflows per gate to beat the reciprocal
+	// estimate, so the autoranging keeps n_avg at or above LSQ_POINTS_MIN.
+	tmr_irq_enable(ch, false);
+	ch->estimator = new_estimator;
+
+	if (CE_LEAST_SQUARES == ch->estimator)
+	{
+		ch->n_avg_min = LSQ_POINTS_MIN;
+	}
+	else
+	{
+		ch->n_avg_min = 1;
+	}
+
+	if (ch->n_avg < ch->n_avg_min)
+	{
+		ch->n_avg = ch->n_avg_min;
+	}
+
+	ch->state = CS_INIT;
+}
+
+bool
+counter_set_gate_ms (counter_channel_t channel, uint32_t gate_ms)
+{
+	channel_t* ch = &channels[channel];
+
+	if ((gate_ms > 0) && ((gate_ms < GATE_MS_MIN) || (gate_ms > GATE_MS_MAX)))
+	{
+		return false;
+	}
+
+	// Abandon the gate in progress and start over with the new gate. Range
+	// from the latest result if there is one, else the first timeout will.
+	tmr_irq_enable(ch, false);
+	ch->fixed_gate_ms = gate_ms;
+	ch->fixed_gate_ticks = gate_ms * SWT_COUNTS_MS;
+
+	if (ch->frequency > 0.0)
+	{
+		autorange(ch, ch->frequency);
+	}
+	else
+	{
+		ch->timeout.length = timeout_min(ch);
+	}
+
+	ch->state = CS_INIT;
+
+	return true;
+}
+
+uint32_t
+counter_gate_ms (counter_channel_t channel)
+{
+	return channels[channel].fixed_gate_ms;
+}
+
+uint32_t
+counter_result_ticks (counter_channel_t channel)
+{
+	return channels[channel].result_ticks;
+}
+
+void
+counter_set_backend (counter_backend_t new_backend)
+{
+	channel_t* ch = &channels[CC_REF];
+
+	// Timer6/7 belongs to the X1 channel.
+	if (CB_TIMER67 == new_backend)
+	{
+		return;
 	}
 
-	LED3_Set();
-	LED3_Clear();
+	// Abandon the gate in progress and start over on the new timer. Its
+	// period is left as it was, and the first timeout will range it. Input
+	// capture interrupts every 3 * IC_EDGES edges whatever the range, so the
+	// autoranging moves inputs over CAPTURE_HZ_MAX back onto Timer1.
+	tmr_irq_enable(ch, false);
+
+	if (ch->ratio_mode && (CB_TIMER1 != new_backend))
+	{
+		counter_set_ratio(false);
+	}
+
+	ch->backend = new_backend;
+	tmr_set_prescale(ch, 1);
+	ch->n_avg = ch->n_avg_min;
+	ch->state = CS_INIT;
+}
+
+counter_backend_t
+counter_backend (void)
+{
+	return channels[CC_REF].backend;
+}
+
+void
+counter_set_ratio (bool enable)
+{
+	channel_t* ch = &channels[CC_REF];
+
+	// Abandon the gate in progress and start over. Ratio mode needs Timer2/3
+	// for the B input, so it always counts A on Timer1.
+	tmr_irq_enable(ch, false);
+
+	if (enable && (CB_TIMER1 != ch->backend))
+	{
+		counter_set_backend(CB_TIMER1);
+	}
+
+	counter_hw_set_ratio_input(enable);
+	ch->ratio_mode = enable;
+	ch->ratio = 0.0;
+	ch->state = CS_INIT;
+}
+
+void
+counter_set_mode (counter_mode_t mode)
+{
+	channel_t* ch = &channels[CC_REF];
+
+	// Abandon the gate or cycle in progress and start over in the new mode.
+	// Frequency mode ranges again from the shortest timeout.
+	if (CM_FREQUENCY == ch->mode)
+	{
+		tmr_irq_enable(ch, false);
+	}
+	else
+	{
+		counter_hw_irq_enable(CB_CAPTURE, false);
+	}
+
+	ch->mode = mode;
+	ch->period_s = 0.0;
+	ch->width_s = 0.0;
+	ch->duty = 0.0;
+
+	if (CM_FREQUENCY == mode)
+	{
+		counter_hw_set_capture_mode(mode);
+		ch->timeout.length = timeout_min(ch);
+	}
+
+	ch->state = CS_INIT;
+}
+
+counter_mode_t
+counter_mode (void)
+{
+	return channels[CC_REF].mode;
+}
+
+double
+counter_period_s (void)
+{
+	return channels[CC_REF].period_s;
+}
+
+double
+counter_width_s (void)
+{
+	return channels[CC_REF].width_s;
+}
+
+double
+counter_duty (void)
+{
+	return channels[CC_REF].duty;
+}
+
+unsigned int
+counter_raw_read (counter_raw_t* out, unsigned int max)
+{
+	unsigned int i;
+
+	for (i = 0; (i < max) && (raw_tail != raw_head); i++)
+	{
+		out[i] = raw_ring[raw_tail & (RAW_RING_LEN - 1)];
+		raw_tail++;
+	}
+
+	return i;
+}
+
+bool
+counter_ratio_mode (void)
+{
+	return channels[CC_REF].ratio_mode;
+}
+
+double
+counter_ratio (void)
+{
+	return channels[CC_REF].ratio;
+}
+
+static inline void
+ts_ring_push (channel_t* ch, uint32_t ticks, uint32_t aux)
+{
+	unsigned int head = ch->ts_head;
+
+	if ((head - ch->ts_tail) < TS_RING_LEN)
+	{
+		ch->ts_ring[head & (TS_RING_LEN - 1)] = ticks;
+		ch->ts_aux[head & (TS_RING_LEN - 1)] = aux;
+		ch->ts_head = head + 1;
+	}
+	else
+	{
+		ch->ts_dropped++;
+	}
+}
+
+void
+counter_hw_timestamp (counter_channel_t ch, uint32_t ticks, uint32_t aux)
+{
+	// Every ISR feeds only its own channel's ring, so each ring keeps a
+	// single producer.
+	ts_ring_push(&channels[ch], ticks, aux);
+}
+
+void
+counter_hw_overrun (counter_channel_t ch)
+{
+	channels[ch].ts_dropped++;
 }
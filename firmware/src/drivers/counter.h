@@ -11,29 +11,164 @@
  *   Copyright 2021 Frequencer Team
  *
  * @brief
- *   Automatic wide-range frequency counter for the signal on T1CK.
+ *   Automatic wide-range frequency counter for the signal on T1CK, counted
+ *   by Timer1, a 32-bit Timer2/3 pair or hardware input capture. PIC_X1 is
+ *   counted at the same time as a second channel, on a 32-bit Timer6/7 pair.
+ *   Period and pulse modes instead time single cycles of T1CK with IC3.
  */
 
 #ifndef COUNTER_H
 #define COUNTER_H
 
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "adev.h"
+#include "kalman.h"
+#include "stats.h"
+
 #define PR1_MIN (1U)
 #define PR1_MAX (65535U)
+#define PR23_MAX (0xFFFFFFFEU)
 
 #define TIMEOUT_MIN (100U)  // ms
 #define TIMEOUT_MAX (4000U)  // ms
 
+#define GATE_MS_MIN (1U)
+#define GATE_MS_MAX (10000U)
+
+#define PULSE_TIMEOUT (20000U)  // ms, longest period timed in period and pulse modes
+
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+typedef enum
+{
+	CE_RECIPROCAL = 0,  // first and last overflow of each gate
+	CE_LEAST_SQUARES,  // linear regression over every overflow of each gate
+}
+counter_estimator_t;
+
+typedef enum
+{
+	CB_TIMER1 = 0,  // 16-bit Timer1 on T1CK with prescaler and n_avg
+	CB_TIMER23,  // 32-bit Timer2/3 pair on T2CK, one overflow per gate
+	CB_CAPTURE,  // IC3 timestamps every 16th edge in hardware, up to 2 MHz
+	CB_TIMER67,  // 32-bit Timer6/7 pair on T6CK, X1 channel only
+}
+counter_backend_t;
+
+typedef enum
+{
+	CM_FREQUENCY = 0,  // gated counting, with autoranging
+	CM_PERIOD,  // time every cycle, rising edge to rising edge
+	CM_PULSE,  // period, high pulse width and duty cycle of every cycle
+}
+counter_mode_t;
+
+// Raw timestamps and settings of one result, for offline analysis. The result
+// spans (period + 1) * prescale * n input edges, from ct_start to ct_stop in
+// core timer ticks (Timer4/5 ticks for IC3 captures, at the same rate). seq
+// counts up by one per result across all channels, so a gap is lost records.
+typedef struct
+{
+	uint32_t seq;
+	uint32_t ct_start;
+	uint32_t ct_stop;
+	uint32_t period;
+	uint32_t n;
+	uint16_t prescale;
+	uint16_t channel;  // counter_channel_t
+}
+counter_raw_t;
+
+// Inputs counted concurrently, each with its own gates, autoranging and
+// results. X20_PIC is the PIC's own clock and UI_X1 has no timer clock input,
+// so neither can be a channel.
+typedef enum
+{
+	CC_REF = 0,  // REF_PIC on T1CK, the timebase reference
+	CC_X1,  // PIC_X1 on T6CK
+}
+counter_channel_t;
+
+#define COUNTER_CHANNELS (2U)
+
+
 void counter_init (void);
 void counter_task (void);
 
-double counter_freq_hz (void);  // return of zero is no frequency available
+double counter_freq_hz (counter_channel_t ch);  // return of zero is no frequency available
+
+// Running statistics of every frequency result since init or last reset.
+const stats_t* counter_stats (counter_channel_t ch);
+void counter_stats_reset (counter_channel_t ch);
+
+// Overlapping Allan deviation over the current run of contiguous gates. Starts
+// over whenever the gate settings change, and needs continuous mode to grow.
+const adev_t* counter_adev (counter_channel_t ch);
+
+// Optional Kalman filter over every result, for filtered frequency and drift
+// with their uncertainties at the full result rate. Off by default.
+void counter_set_kalman (counter_channel_t ch, bool enable);
+bool counter_kalman_mode (counter_channel_t ch);
+const kalman_t* counter_kalman (counter_channel_t ch);
+
+// RMS noise on each gate timestamp in s, which sets the filter's trust in
+// each result. Zero (default) picks one for the backend: ISR latency spread
+// for the timers, quantisation alone for input capture. Set it from the
+// board's measured latency if results keep landing outside the filter's gate.
+void counter_set_kalman_noise (counter_channel_t ch, double noise_s);
+double counter_kalman_noise (counter_channel_t ch);  // in use
+
+// Continuous mode (default) starts each gate on the overflow that ended the
+// previous one, so no input signal time is lost between measurements.
+void counter_set_continuous (counter_channel_t ch, bool enable);
+
+void counter_set_estimator (counter_channel_t ch, counter_estimator_t estimator);
+
+// Fixed gate mode gives one result per gate_ms, GATE_MS_MIN to GATE_MS_MAX,
+// as long as the gate spans at least one timer overflow: 2 input edges, or
+// IC_EDGES on the capture backend. Slower inputs give a result per overflow
+// instead, further apart than gate_ms. Zero (default) lets the autoranging
+// pick the gate length. Returns false if gate_ms is out of range.
+bool counter_set_gate_ms (counter_channel_t ch, uint32_t gate_ms);
+uint32_t counter_gate_ms (counter_channel_t ch);
+
+// Core timer ticks at the end of the gate of the latest result.
+uint32_t counter_result_ticks (counter_channel_t ch);
+
+// REF channel only. CB_TIMER67 is ignored, as it belongs to the X1 channel.
+// CB_CAPTURE takes inputs up to 2 MHz, and the autoranging falls back to
+// CB_TIMER1 for anything faster.
+void counter_set_backend (counter_backend_t backend);
+counter_backend_t counter_backend (void);
+
+// Ratio mode counts a second input, B, on Timer2/3 over the same gates as
+// T1CK, A. counter_ratio() is then A/B, free of the PIC timebase error, and
+// zero until the first gate. REF channel only, and forces the Timer1 backend.
+void counter_set_ratio (bool enable);
+bool counter_ratio_mode (void);
+double counter_ratio (void);
+
+// Period and pulse modes give a result after every input cycle, for signals
+// too slow to count, down to one cycle per PULSE_TIMEOUT. IC3 timestamps each
+// edge on Timer4/5, so they suit inputs up to a few kHz. counter_freq_hz()
+// and counter_stats() follow 1 / period. REF channel only.
+void counter_set_mode (counter_mode_t mode);
+counter_mode_t counter_mode (void);
+double counter_period_s (void);  // zero until the first cycle
+double counter_width_s (void);  // pulse mode only, else zero
+double counter_duty (void);  // pulse mode only, 0.0 to 1.0
+
+// Take up to max of the oldest raw records not yet read, and return how many
+// there were. Records are kept for every result of every channel, and the
+// oldest are overwritten if they aren't read in time.
+unsigned int counter_raw_read (counter_raw_t* out, unsigned int max);
 
 
 #ifdef __cplusplus
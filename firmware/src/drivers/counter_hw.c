@@ -0,0 +1,636 @@
+/*
+ * Frequency Counter Hardware
+ *
+ * @file
+ *   counter_hw.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Every register the frequency counter touches: Timer1, the Timer2/3,
+ *   Timer4/5 and Timer6/7 pairs, IC3, their pin mappings and interrupts.
+ *   The ISRs timestamp each event with the core timer and hand it to
+ *   counter.c, which is left with no hardware access of its own.
+ */
+
+#include <definitions.h>
+#include "hang_here.h"
+
+#include "counter_hw.h"
+
+// IC3 capture modes (ICM).
+#define ICM_RISING (0b011U)  // every rising edge
+#define ICM_RISING_16 (0b101U)  // every 16th rising edge
+#define ICM_EDGES (0b110U)  // every edge, FEDGE first
+
+// T2CKR input mappings. Ratio mode counts RATIO_B_PIN as the B input.
+#define T2CK_RPC14 (0b0111U)  // REF_PIC, the T1CK pin
+#define T2CK_RPB10 (0b0110U)  // PIC_X1
+#define RATIO_B_PIN T2CK_RPB10
+
+// T6CKR input mapping, from the same PPS input group as T2CKR.
+#define T6CK_RPB10 (0b0110U)  // PIC_X1
+
+// IC3R input mapping.
+#define IC3_RPC14 (0b0111U)  // REF_PIC, the T1CK pin
+
+
+void
+counter_hw_init (void)
+{
+	PMD4bits.T1MD = 0;
+	T1CONbits.ON = 0;
+	_nop();
+
+	T1CONbits.SIDL = 0;
+	T1CONbits.TWDIS = 1;
+	T1CONbits.TGATE = 0;
+	T1CONbits.TCKPS = 0b00;
+	T1CONbits.TSYNC = 0;
+	T1CONbits.TCS = 1;
+	TMR1 = 0;
+
+	IPC1bits.T1IP = 7;
+	IPC1bits.T1IS = 0;
+	IFS0bits.T1IF = 0;
+	IEC0bits.T1IE = 0;
+
+	T1CONbits.ON = 1;
+
+	// Timer2/3 as one 32-bit timer clocked from T2CK. In 32-bit mode Timer2
+	// holds the count and period, and Timer3 raises the interrupt. T2CK and
+	// IC3 are mapped onto RPC14, the T1CK pin, so all backends see the same
+	// signal. ICACLK moves IC3 off Timer2/3 onto Timer4/5. T6CK takes PIC_X1
+	// for the X1 channel.
+	SYSKEY = 0x00000000;
+	SYSKEY = 0xAA996655;
+	SYSKEY = 0x556699AA;
+	CFGCONbits.IOLOCK = 0;
+	T2CKR = T2CK_RPC14;
+	IC3R = IC3_RPC14;
+	T6CKR = T6CK_RPB10;
+	CFGCONbits.ICACLK = 1;
+	CFGCONbits.IOLOCK = 1;
+	SYSKEY = 0x00000000;
+
+	PMD4bits.T2MD = 0;
+	PMD4bits.T3MD = 0;
+	T2CONbits.ON = 0;
+	T3CONbits.ON = 0;
+	_nop();
+
+	T2CONbits.SIDL = 0;
+	T2CONbits.TGATE = 0;
+	T2CONbits.TCKPS = 0b000;
+	T2CONbits.T32 = 1;
+	T2CONbits.TCS = 1;
+	TMR2 = 0;
+	PR2 = PR1_MAX;
+
+	IPC3bits.T3IP = 7;
+	IPC3bits.T3IS = 0;
+	IFS0bits.T3IF = 0;
+	IEC0bits.T3IE = 0;
+
+	T2CONbits.ON = 1;
+
+	// Timer4/5 as a free-running 32-bit timebase for IC3. PBCLK3 at 1:2 runs
+	// it at the core timer rate, so captures are core timer ticks, and both
+	// wrap alike.
+	PMD4bits.T4MD = 0;
+	PMD4bits.T5MD = 0;
+	T4CONbits.ON = 0;
+	T5CONbits.ON = 0;
+	_nop();
+
+	T4CONbits.SIDL = 0;
+	T4CONbits.TGATE = 0;
+	T4CONbits.TCKPS = 0b001;
+	T4CONbits.T32 = 1;
+	T4CONbits.TCS = 0;
+	TMR4 = 0;
+	PR4 = UINT32_MAX;
+
+	T4CONbits.ON = 1;
+
+	// IC3 latches the timebase on every 16th rising edge of the input, and
+	// interrupts once 3 captures are in its 4-deep FIFO. The last slot is
+	// headroom for the ISR's latency.
+	PMD3bits.IC3MD = 0;
+	IC3CONbits.ON = 0;
+	_nop();
+
+	IC3CONbits.SIDL = 0;
+	IC3CONbits.C32 = 1;
+	IC3CONbits.ICTMR = 1;
+	IC3CONbits.ICI = 0b10;
+	IC3CONbits.ICM = ICM_RISING_16;
+	IC3CONbits.FEDGE = 1;
+
+	IPC4bits.IC3IP = 7;
+	IPC4bits.IC3IS = 0;
+	IFS0bits.IC3IF = 0;
+	IEC0bits.IC3IE = 0;
+
+	IC3CONbits.ON = 1;
+
+	// Timer6/7 as one 32-bit timer clocked from T6CK, for the X1 channel.
+	// Timer6 holds the count and period, and Timer7 raises the interrupt.
+	PMD4bits.T6MD = 0;
+	PMD4bits.T7MD = 0;
+	T6CONbits.ON = 0;
+	T7CONbits.ON = 0;
+	_nop();
+
+	T6CONbits.SIDL = 0;
+	T6CONbits.TGATE = 0;
+	T6CONbits.TCKPS = 0b000;
+	T6CONbits.T32 = 1;
+	T6CONbits.TCS = 1;
+	TMR6 = 0;
+	PR6 = PR1_MAX;
+
+	IPC8bits.T7IP = 7;
+	IPC8bits.T7IS = 0;
+	IFS1bits.T7IF = 0;
+	IEC1bits.T7IE = 0;
+
+	T6CONbits.ON = 1;
+}
+
+static unsigned int
+timer1_prescale (void)
+{
+	switch (T1CONbits.TCKPS)
+	{
+		case 0b00:
+		{
+			return 1;
+		}
+
+		case 0b01:
+		{
+			return 8;
+		}
+
+		case 0b10:
+		{
+			return 64;
+		}
+
+		case 0b11:
+		{
+			return 256;
+		}
+
+		default:
+		{
+			HANG_HERE();
+		}
+	}
+}
+
+static void
+timer1_set_prescale (unsigned int prescale)
+{
+	unsigned int tckps;
+
+	switch (prescale)
+	{
+		case 1:
+		{
+			tckps = 0b00;
+
+			break;
+		}
+
+		case 8:
+		{
+			tckps = 0b01;
+
+			break;
+		}
+
+		case 64:
+		{
+			tckps = 0b10;
+
+			break;
+		}
+
+		case 256:
+		{
+			tckps = 0b11;
+
+			break;
+		}
+
+		default:
+		{
+			HANG_HERE();
+		}
+	}
+
+	if (tckps == T1CONbits.TCKPS)
+	{
+		return;
+	}
+
+	// Prescaler must only be changed with the timer off. Clearing TMR1 also
+	// clears the prescaler count, so the next overflow is a whole period.
+	T1CONbits.ON = 0;
+	_nop();
+	T1CONbits.TCKPS = tckps;
+	TMR1 = 0;
+	T1CONbits.ON = 1;
+}
+
+// Counting timer access by backend. Timer2/3 and Timer6/7 need no prescaler,
+// as their 32-bit period covers the whole range at 1:1. Input capture has no
+// period register at all - every capture is a fixed IC_EDGES input edges.
+
+uint32_t
+counter_hw_period (counter_backend_t backend)
+{
+	switch (backend)
+	{
+		case CB_TIMER23:
+		{
+			return PR2;
+		}
+
+		case CB_TIMER67:
+		{
+			return PR6;
+		}
+
+		case CB_CAPTURE:
+		{
+			return IC_EDGES - 1;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			return PR1;
+		}
+	}
+}
+
+uint32_t
+counter_hw_period_min (counter_backend_t backend)
+{
+	return (CB_CAPTURE == backend) ? (IC_EDGES - 1) : PR1_MIN;
+}
+
+uint32_t
+counter_hw_period_max (counter_backend_t backend)
+{
+	switch (backend)
+	{
+		case CB_TIMER23:
+		case CB_TIMER67:
+		{
+			return PR23_MAX;
+		}
+
+		case CB_CAPTURE:
+		{
+			return IC_EDGES - 1;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			return PR1_MAX;
+		}
+	}
+}
+
+uint32_t
+counter_hw_count (counter_backend_t backend)
+{
+	// Input capture can't tell how far the next capture has got.
+	switch (backend)
+	{
+		case CB_TIMER23:
+		{
+			return TMR2;
+		}
+
+		case CB_TIMER67:
+		{
+			return TMR6;
+		}
+
+		case CB_CAPTURE:
+		{
+			return 0;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			return TMR1;
+		}
+	}
+}
+
+void
+counter_hw_clear (counter_backend_t backend)
+{
+	switch (backend)
+	{
+		case CB_TIMER23:
+		{
+			TMR2 = 0;
+
+			break;
+		}
+
+		case CB_TIMER67:
+		{
+			TMR6 = 0;
+
+			break;
+		}
+
+		case CB_CAPTURE:
+		{
+			// Drop stale captures, so the next one is of a fresh edge.
+			while (IC3CONbits.ICBNE)
+			{
+				(void)IC3BUF;
+			}
+
+			break;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			TMR1 = 0;
+
+			break;
+		}
+	}
+}
+
+void
+counter_hw_set_period (counter_backend_t backend, uint32_t period)
+{
+	// Clearing the count too prevents it running on to rollover when the
+	// period is reduced below it.
+	if (period == counter_hw_period(backend))
+	{
+		return;
+	}
+
+	switch (backend)
+	{
+		case CB_TIMER23:
+		{
+			PR2 = period;
+
+			break;
+		}
+
+		case CB_TIMER67:
+		{
+			PR6 = period;
+
+			break;
+		}
+
+		case CB_CAPTURE:
+		{
+			return;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			PR1 = period;
+
+			break;
+		}
+	}
+
+	counter_hw_clear(backend);
+}
+
+unsigned int
+counter_hw_prescale (counter_backend_t backend)
+{
+	return (CB_TIMER1 == backend) ? timer1_prescale() : 1;
+}
+
+unsigned int
+counter_hw_prescale_max (counter_backend_t backend)
+{
+	return (CB_TIMER1 == backend) ? 256 : 1;
+}
+
+void
+counter_hw_set_prescale (counter_backend_t backend, unsigned int prescale)
+{
+	if (CB_TIMER1 == backend)
+	{
+		timer1_set_prescale(prescale);
+	}
+}
+
+void
+counter_hw_irq_enable (counter_backend_t backend, bool enable)
+{
+	switch (backend)
+	{
+		case CB_TIMER23:
+		{
+			IEC0bits.T3IE = enable;
+
+			break;
+		}
+
+		case CB_TIMER67:
+		{
+			IEC1bits.T7IE = enable;
+
+			break;
+		}
+
+		case CB_CAPTURE:
+		{
+			IEC0bits.IC3IE = enable;
+
+			break;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			IEC0bits.T1IE = enable;
+
+			break;
+		}
+	}
+}
+
+void
+counter_hw_irq_clear (counter_backend_t backend)
+{
+	switch (backend)
+	{
+		case CB_TIMER23:
+		{
+			IFS0bits.T3IF = 0;
+
+			break;
+		}
+
+		case CB_TIMER67:
+		{
+			IFS1bits.T7IF = 0;
+
+			break;
+		}
+
+		case CB_CAPTURE:
+		{
+			IFS0bits.IC3IF = 0;
+
+			break;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			IFS0bits.T1IF = 0;
+
+			break;
+		}
+	}
+}
+
+void
+counter_hw_set_capture_mode (counter_mode_t mode)
+{
+	// Turning IC3 off empties its FIFO and restarts the edge sequence, so in
+	// pulse mode the next capture is always a rising edge. Single edges are
+	// interrupted on straight away, as slow signals are what these modes are
+	// for.
+	IC3CONbits.ON = 0;
+	_nop();
+
+	switch (mode)
+	{
+		case CM_PERIOD:
+		{
+			IC3CONbits.ICM = ICM_RISING;
+			IC3CONbits.ICI = 0b00;
+
+			break;
+		}
+
+		case CM_PULSE:
+		{
+			IC3CONbits.ICM = ICM_EDGES;
+			IC3CONbits.ICI = 0b00;
+
+			break;
+		}
+
+		case CM_FREQUENCY:
+		default:
+		{
+			IC3CONbits.ICM = ICM_RISING_16;
+			IC3CONbits.ICI = 0b10;
+
+			break;
+		}
+	}
+
+	IC3CONbits.ON = 1;
+}
+
+void
+counter_hw_set_ratio_input (bool enable)
+{
+	T2CONbits.ON = 0;
+	_nop();
+
+	SYSKEY = 0x00000000;
+	SYSKEY = 0xAA996655;
+	SYSKEY = 0x556699AA;
+	CFGCONbits.IOLOCK = 0;
+	T2CKR = enable ? RATIO_B_PIN : T2CK_RPC14;
+	CFGCONbits.IOLOCK = 1;
+	SYSKEY = 0x00000000;
+
+	// B count differences wrap correctly only over the full 32 bits.
+	if (enable)
+	{
+		PR2 = UINT32_MAX;
+	}
+
+	TMR2 = 0;
+	T2CONbits.ON = 1;
+}
+
+
+// Keep the ISRs minimal - they run at IPL7 and delay USB and SPI servicing.
+// The timestamp is taken first to minimise latency jitter. Timer1 also samples
+// TMR2 for ratio mode, straight after, so both see the same latency.
+
+void
+__ISR (_TIMER_1_VECTOR, ipl7SRS) counter_timer1_isr(void)
+{
+	uint32_t ticks = __builtin_mfc0(_CP0_COUNT, _CP0_COUNT_SELECT);
+
+	counter_hw_timestamp(CC_REF, ticks, TMR2);
+	IFS0bits.T1IF = 0;
+}
+
+void
+__ISR (_TIMER_3_VECTOR, ipl7SRS) counter_timer3_isr(void)
+{
+	counter_hw_timestamp(CC_REF, __builtin_mfc0(_CP0_COUNT, _CP0_COUNT_SELECT), 0);
+	IFS0bits.T3IF = 0;
+}
+
+void
+__ISR (_INPUT_CAPTURE_3_VECTOR, ipl7SRS) counter_ic3_isr(void)
+{
+	// The timestamps were latched by hardware, so latency here doesn't
+	// matter, unless it outlasts the FIFO headroom. Empty the FIFO before
+	// clearing the flag, else it fires again.
+	bool overflow = IC3CONbits.ICOV;
+
+	while (IC3CONbits.ICBNE)
+	{
+		counter_hw_timestamp(CC_REF, IC3BUF, 0);
+	}
+
+	if (overflow)
+	{
+		// Captures were lost behind a full FIFO. Restarting IC3 clears ICOV,
+		// and counter.c starts the gate over.
+		IC3CONbits.ON = 0;
+		_nop();
+		IC3CONbits.ON = 1;
+		counter_hw_overrun(CC_REF);
+	}
+
+	IFS0bits.IC3IF = 0;
+}
+
+void
+__ISR (_TIMER_7_VECTOR, ipl7SRS) counter_timer7_isr(void)
+{
+	counter_hw_timestamp(CC_X1, __builtin_mfc0(_CP0_COUNT, _CP0_COUNT_SELECT), 0);
+	IFS1bits.T7IF = 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Frequency Counter Hardware
+ *
+ * @file
+ *   counter_hw.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Every register the frequency counter touches: Timer1, the Timer2/3,
+ *   Timer4/5 and Timer6/7 pairs, IC3, their pin mappings and interrupts.
+ *   The ISRs timestamp each event with the core timer and hand it to
+ *   counter.c, which is left with no hardware access of its own.
+ */
+
+#ifndef COUNTER_HW_H
+#define COUNTER_HW_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "counter.h"
+
+// Input edges per hardware capture, fixed by the every-16th-edge IC mode.
+#define IC_EDGES (16U)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+void counter_hw_init (void);
+
+// Counting timer of each backend. Period is the PR value, so an overflow is
+// (period + 1) * prescale input edges. Input capture ignores period and
+// prescale writes, and always reads IC_EDGES - 1 and 1.
+uint32_t counter_hw_period (counter_backend_t backend);
+uint32_t counter_hw_period_min (counter_backend_t backend);
+uint32_t counter_hw_period_max (counter_backend_t backend);
+void counter_hw_set_period (counter_backend_t backend, uint32_t period);  // clears the count
+uint32_t counter_hw_count (counter_backend_t backend);
+void counter_hw_clear (counter_backend_t backend);
+unsigned int counter_hw_prescale (counter_backend_t backend);
+unsigned int counter_hw_prescale_max (counter_backend_t backend);
+void counter_hw_set_prescale (counter_backend_t backend, unsigned int prescale);  // 1, 8, 64 or 256
+void counter_hw_irq_enable (counter_backend_t backend, bool enable);
+void counter_hw_irq_clear (counter_backend_t backend);
+
+// IC3 capture setup for a measurement mode. Restarts IC3, emptying its FIFO.
+void counter_hw_set_capture_mode (counter_mode_t mode);
+
+// Count the ratio mode B input on Timer2/3 instead of T1CK, free-running.
+void counter_hw_set_ratio_input (bool enable);
+
+// Implemented by counter.c. Called from the ISRs with each event's core timer
+// (or Timer4/5 capture) timestamp, and the ratio mode B count for CC_REF.
+void counter_hw_timestamp (counter_channel_t ch, uint32_t ticks, uint32_t aux);
+
+// Implemented by counter.c. Called from the ISRs when timestamps were lost
+// before they could be taken, as when the IC3 FIFO overflows.
+void counter_hw_overrun (counter_channel_t ch);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COUNTER_HW_H */
@@ -0,0 +1,115 @@
+/*
+ * Die Temperature Sensor
+ *
+ * @file
+ *   die_temp.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Periodically samples the on-die temperature sensor (AN44) with the
+ *   ADCHS shared ADC, and keeps a smoothed reading.
+ */
+
+#include <definitions.h>
+#include <stdbool.h>
+
+#include "sw_timer.h"
+
+#include "die_temp.h"
+
+// Typical sensor transfer function, from the datasheet. Only consistency
+// matters to the timebase, which learns its model against this scale.
+#define DT_VREF (3.3)  // V, AVDD
+#define DT_V_25C (0.7)  // V
+#define DT_SLOPE (0.005)  // V/C
+
+// Shared ADC sample time, in TAD. The sensor has a high source impedance.
+#define DT_SAMC (255U)
+
+
+static sw_timer_t sample_timer;
+static bool pending, valid;
+static double temp_c;
+
+
+void
+die_temp_init (void)
+{
+	sample_timer = SW_TIMER(DT_PERIOD_MS);
+	sw_timer_reset(&sample_timer);
+	pending = false;
+	valid = false;
+	temp_c = 0.0;
+
+	// The shared ADC (ADC7) converts the class 3 inputs. Its calibration and
+	// the shared sample time can only be set with the ADCHS off.
+	ADCCON1bits.ON = 0;
+	ADC7CFG = DEVADC7;
+	ADCCON2bits.SAMC = DT_SAMC;
+	ADCCON1bits.ON = 1;
+
+	while (!ADCCON2bits.BGVRRDY)
+	{
+	}
+
+	while (ADCCON2bits.REFFLT)
+	{
+	}
+
+	ADCANCONbits.ANEN7 = 1;
+
+	while (!ADCANCONbits.WKRDY7)
+	{
+	}
+
+	ADCCON3bits.DIGEN7 = 1;
+}
+
+void
+die_temp_task (void)
+{
+	// Read each conversion one period after requesting it, so the task
+	// never waits on the ADC.
+	if (!sw_timer_expired(&sample_timer))
+	{
+		return;
+	}
+
+	sw_timer_reset(&sample_timer);
+
+	if (pending && ADCHS_ChannelResultIsReady(ADCHS_CH44))
+	{
+		double volts = ((double)ADCHS_ChannelResultGet(ADCHS_CH44) * DT_VREF) / 4095.0;
+		double sample = 25.0 + ((volts - DT_V_25C) / DT_SLOPE);
+
+		if (valid)
+		{
+			temp_c += (sample - temp_c) / (double)DT_AVG_SAMPLES;
+		}
+		else
+		{
+			temp_c = sample;
+			valid = true;
+		}
+	}
+
+	ADCHS_ChannelConversionStart(ADCHS_CH44);
+	pending = true;
+}
+
+bool
+die_temp_valid (void)
+{
+	return valid;
+}
+
+double
+die_temp_c (void)
+{
+	return temp_c;
+}
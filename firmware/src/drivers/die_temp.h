@@ -0,0 +1,45 @@
+/*
+ * Die Temperature Sensor
+ *
+ * @file
+ *   die_temp.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Periodically samples the on-die temperature sensor (AN44) with the
+ *   ADCHS shared ADC, and keeps a smoothed reading.
+ */
+
+#ifndef DIE_TEMP_H
+#define DIE_TEMP_H
+
+
+#include <stdbool.h>
+
+
+#define DT_PERIOD_MS (250U)
+#define DT_AVG_SAMPLES (8U)  // smoothing time constant, in samples
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+void die_temp_init (void);  // after ADCHS_Initialize
+void die_temp_task (void);
+
+bool die_temp_valid (void);
+double die_temp_c (void);  // zero until valid
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIE_TEMP_H */
@@ -0,0 +1,122 @@
+/*
+ * Frequency and Drift Kalman Filter
+ *
+ * @file
+ *   kalman.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Two-state (frequency, drift) Kalman filter over a stream of frequency
+ *   results. Process noise is given as fractional frequency random walk and
+ *   drift random walk, so one setting suits any input frequency.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "kalman.h"
+
+
+void
+kalman_reset (kalman_t* kf)
+{
+	kf->freq = 0.0;
+	kf->drift = 0.0;
+	kf->samples = 0;
+	kf->_p00 = 0.0;
+	kf->_p01 = 0.0;
+	kf->_p11 = 0.0;
+	kf->_outliers = 0;
+}
+
+void
+kalman_set_noise (kalman_t* kf, double q_freq, double q_drift)
+{
+	kf->q_freq = q_freq;
+	kf->q_drift = q_drift;
+}
+
+void
+kalman_add (kalman_t* kf, double y, double r, double dt)
+{
+	double s2, p00, p01, p11, innov, s, k0, k1;
+
+	if (0 == kf->samples)
+	{
+		// Start from the first result, with no drift known yet.
+		double drift_sd = KF_DRIFT_SD_INIT * y;
+
+		kf->freq = y;
+		kf->drift = 0.0;
+		kf->_p00 = r;
+		kf->_p01 = 0.0;
+		kf->_p11 = drift_sd * drift_sd;
+		kf->_outliers = 0;
+		kf->samples = 1;
+
+		return;
+	}
+
+	// Predict over dt with F = [1 dt; 0 1], and the process noise of an
+	// integrated random walk scaled to the frequency.
+	s2 = kf->freq * kf->freq;
+	p00 = kf->_p00 + (dt * ((2.0 * kf->_p01) + (dt * kf->_p11)));
+	p01 = kf->_p01 + (dt * kf->_p11);
+	p11 = kf->_p11;
+
+	p00 += s2 * ((kf->q_freq * dt) + ((kf->q_drift * dt * dt * dt) / 3.0));
+	p01 += s2 * ((kf->q_drift * dt * dt) / 2.0);
+	p11 += s2 * (kf->q_drift * dt);
+
+	kf->freq += kf->drift * dt;
+	kf->_p00 = p00;
+	kf->_p01 = p01;
+	kf->_p11 = p11;
+
+	// A result far outside the prediction is held back, in case it's a
+	// glitch. A run of them means the input has really changed.
+	innov = y - kf->freq;
+	s = p00 + r;
+
+	if ((innov * innov) > (KF_GATE_SIGMA * KF_GATE_SIGMA * s))
+	{
+		kf->_outliers++;
+
+		if (kf->_outliers >= KF_OUTLIER_MAX)
+		{
+			kf->samples = 0;
+			kalman_add(kf, y, r, 0.0);
+		}
+
+		return;
+	}
+
+	kf->_outliers = 0;
+
+	// Update with H = [1 0].
+	k0 = p00 / s;
+	k1 = p01 / s;
+	kf->freq += k0 * innov;
+	kf->drift += k1 * innov;
+	kf->_p00 = (1.0 - k0) * p00;
+	kf->_p01 = (1.0 - k0) * p01;
+	kf->_p11 = p11 - (k1 * p01);
+	kf->samples++;
+}
+
+double
+kalman_freq_sd (const kalman_t* kf)
+{
+	return sqrt(kf->_p00);
+}
+
+double
+kalman_drift_sd (const kalman_t* kf)
+{
+	return sqrt(kf->_p11);
+}
@@ -0,0 +1,65 @@
+/*
+ * Frequency and Drift Kalman Filter
+ *
+ * @file
+ *   kalman.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Two-state (frequency, drift) Kalman filter over a stream of frequency
+ *   results. Process noise is given as fractional frequency random walk and
+ *   drift random walk, so one setting suits any input frequency.
+ */
+
+#ifndef KALMAN_H
+#define KALMAN_H
+
+
+#include <stdint.h>
+
+
+#define KF_Q_FREQ_DEFAULT (1e-20)  // fractional frequency random walk, 1/s
+#define KF_Q_DRIFT_DEFAULT (1e-26)  // fractional drift random walk, 1/s^3
+#define KF_DRIFT_SD_INIT (1e-6)  // fractional drift uncertainty at start, 1/s
+#define KF_GATE_SIGMA (6.0)  // results further out than this are outliers
+#define KF_OUTLIER_MAX (3U)  // consecutive outliers that restart the filter
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct
+{
+	double freq;  // Hz
+	double drift;  // Hz/s
+	uint32_t samples;  // since last restart
+	double q_freq;
+	double q_drift;
+	double _p00, _p01, _p11;  // covariance - use kalman_*_sd
+	unsigned int _outliers;
+}
+kalman_t;
+
+
+void kalman_reset (kalman_t* kf);  // keeps the process noise settings
+void kalman_set_noise (kalman_t* kf, double q_freq, double q_drift);
+
+// Feed result y in Hz with variance r in Hz^2, dt seconds after the previous.
+void kalman_add (kalman_t* kf, double y, double r, double dt);
+
+double kalman_freq_sd (const kalman_t* kf);  // Hz
+double kalman_drift_sd (const kalman_t* kf);  // Hz/s
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KALMAN_H */
@@ -0,0 +1,116 @@
+/*
+ * Streaming Statistics
+ *
+ * @file
+ *   stats.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Constant-memory running statistics over a stream of samples. Mean and
+ *   variance use Welford's method, so no sample history is kept apart from a
+ *   short ring of the most recent values.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "stats.h"
+
+
+void
+stats_reset (stats_t* stats)
+{
+	unsigned int i;
+
+	stats->count = 0;
+	stats->mean = 0.0;
+	stats->_m2 = 0.0;
+	stats->min = 0.0;
+	stats->max = 0.0;
+	stats->_recent_idx = 0;
+
+	for (i = 0; i < STATS_RECENT_LEN; i++)
+	{
+		stats->_recent[i] = 0.0;
+	}
+}
+
+void
+stats_add (stats_t* stats, double value)
+{
+	double delta;
+
+	if (0 == stats->count)
+	{
+		stats->min = value;
+		stats->max = value;
+	}
+	else if (value < stats->min)
+	{
+		stats->min = value;
+	}
+	else if (value > stats->max)
+	{
+		stats->max = value;
+	}
+
+	// Welford's update. Deviations are taken from the running mean, so there
+	// is no loss of precision when the spread is tiny compared to the value.
+	stats->count++;
+	delta = value - stats->mean;
+	stats->mean += delta / (double)(stats->count);
+	stats->_m2 += delta * (value - stats->mean);
+
+	stats->_recent[stats->_recent_idx] = value;
+	stats->_recent_idx++;
+
+	if (stats->_recent_idx >= STATS_RECENT_LEN)
+	{
+		stats->_recent_idx = 0;
+	}
+}
+
+double
+stats_variance (const stats_t* stats)
+{
+	if (stats->count < 2)
+	{
+		return 0.0;
+	}
+
+	return stats->_m2 / (double)(stats->count - 1);
+}
+
+double
+stats_stddev (const stats_t* stats)
+{
+	return sqrt(stats_variance(stats));
+}
+
+unsigned int
+stats_recent (const stats_t* stats, double* out, unsigned int max)
+{
+	unsigned int i, n, idx;
+
+	n = (stats->count < STATS_RECENT_LEN) ? stats->count : STATS_RECENT_LEN;
+
+	if (n > max)
+	{
+		n = max;
+	}
+
+	idx = stats->_recent_idx;
+
+	for (i = 0; i < n; i++)
+	{
+		idx = (idx > 0) ? (idx - 1) : (STATS_RECENT_LEN - 1);
+		out[i] = stats->_recent[idx];
+	}
+
+	return n;
+}
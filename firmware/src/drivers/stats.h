@@ -0,0 +1,59 @@
+/*
+ * Streaming Statistics
+ *
+ * @file
+ *   stats.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Constant-memory running statistics over a stream of samples. Mean and
+ *   variance use Welford's method, so no sample history is kept apart from a
+ *   short ring of the most recent values.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+
+#include <stdint.h>
+
+
+#define STATS_RECENT_LEN (16U)
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct
+{
+	uint32_t count;
+	double mean;
+	double _m2;  // sum of squared deviations from mean - use stats_variance
+	double min;
+	double max;
+	double _recent[STATS_RECENT_LEN];  // use stats_recent
+	unsigned int _recent_idx;  // next slot to be written
+}
+stats_t;
+
+
+void stats_reset (stats_t* stats);
+void stats_add (stats_t* stats, double value);
+
+double stats_variance (const stats_t* stats);  // sample variance, zero if count < 2
+double stats_stddev (const stats_t* stats);
+unsigned int stats_recent (const stats_t* stats, double* out, unsigned int max);  // newest first
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STATS_H */
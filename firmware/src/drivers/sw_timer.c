@@ -12,7 +12,10 @@
  *
  * @brief
  *   Provides simple configurable timers backed by the CPU core timer.
- *   All values are always in milliseconds.
+ *   sw_timer_t lengths and sw_timer_elapsed() are in milliseconds. Everything
+ *   else is in core timer ticks until it is converted for presentation.
+ *   The 32-bit core timer is extended to 64 bits in software, so timer math
+ *   is plain unsigned subtraction with no wrap to handle.
  */
 
 #include <stdbool.h>
@@ -21,54 +24,88 @@
 #include "sw_timer.h"
 
 
-uint32_t
-sw_timer_elapsed (sw_timer_t* timer)
+static double scale = 1.0;
+
+// Calibrated nanoseconds and seconds per tick, so conversions multiply rather
+// than divide.
+static double ns_tick = 1.0 / SWT_COUNTS_NS;
+static double s_tick = 1.0 / (SWT_COUNTS_NS * 1000000000.0);
+
+// Core timer extended to 64 bits: ticks_high counts the wraps, and ticks_last
+// is the core timer as last read, to see the next one.
+static uint32_t ticks_last;
+static uint64_t ticks_high;
+
+
+uint64_t
+sw_timer_ticks64 (void)
 {
-	// On the PIC32MZ this is atomic
-	uint32_t local_ticks = sw_timer_time();
+	// Any read at all in the last wrap period catches the wrap, as only
+	// one can have happened since.
+	uint32_t now = sw_timer_ticks();
 
-	if (!(timer->running))
+	if (now < ticks_last)
 	{
-		local_ticks = timer->_pause;
+		ticks_high += (uint64_t)1 << 32;
 	}
 
-	if (local_ticks >= timer->_start)
-	{
-		return local_ticks - timer->_start;
-	}
-	else
-	{
-		return SWT_ROLLOVER_MS - timer->_start - local_ticks;
-	}
+	ticks_last = now;
+
+	return ticks_high | now;
+}
+
+uint64_t
+sw_timer_elapsed_ticks (sw_timer_t* timer)
+{
+	uint64_t end = timer->running ? sw_timer_ticks64() : timer->_pause;
+
+	return end - timer->_start;
+}
+
+uint32_t
+sw_timer_elapsed (sw_timer_t* timer)
+{
+	uint64_t ms = sw_timer_elapsed_ticks(timer) / SWT_COUNTS_MS;
+
+	return (ms > UINT32_MAX) ? UINT32_MAX : (uint32_t)ms;
+}
+
+uint64_t
+ns_timer_elapsed_ticks (ns_timer_t* timer)
+{
+	uint64_t end = timer->running ? sw_timer_ticks64() : timer->_pause;
+
+	return end - timer->_start;
 }
 
 double
 ns_timer_elapsed (ns_timer_t* timer)
 {
-	// On the PIC32MZ this is atomic
-	uint32_t local_ticks = sw_timer_ticks();
-
-	if (!(timer->running))
-	{
-		local_ticks = timer->_pause;
-	}
+	return (double)ns_timer_elapsed_ticks(timer) * ns_tick;
+}
 
-	return ns_time_delta(timer->_start, local_ticks);
+double
+sw_timer_ticks_ns (double ticks)
+{
+	return ticks * ns_tick;
 }
 
 double
-ns_time_delta (uint32_t ticks_start, uint32_t ticks_end)
+sw_timer_ticks_s (double ticks)
 {
-	uint32_t delta_ticks;
+	return ticks * s_tick;
+}
 
-	if (ticks_end >= ticks_start)
-	{
-		delta_ticks = ticks_end - ticks_start;
-	}
-	else
-	{
-		delta_ticks = UINT32_MAX - ticks_start - ticks_end;
-	}
+void
+sw_timer_set_scale (double new_scale)
+{
+	scale = new_scale;
+	ns_tick = 1.0 / (SWT_COUNTS_NS * new_scale);
+	s_tick = ns_tick / 1000000000.0;
+}
 
-	return delta_ticks / SWT_COUNTS_NS;
+double
+sw_timer_scale (void)
+{
+	return scale;
 }
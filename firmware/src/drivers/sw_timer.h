@@ -12,9 +12,14 @@
  *
  * @brief
  *   Provides simple configurable timers backed by the CPU core timer.
- *   sw_timer_t values are in milliseconds, and ns_timer_t values are in
- *   nanoseconds. Values of internal members beginning with an underscore
+ *   sw_timer_t values are in milliseconds, and ns_timer_t values are in core
+ *   timer ticks, with conversions from nanoseconds folded at compile time.
+ *   Values of internal members beginning with an underscore
  *   may be in any units and should not be accessed by consumer code.
+ *   Ticks convert to nanoseconds and seconds only for presentation, corrected
+ *   by a runtime scale, the measured core timer rate over the nominal one, so
+ *   they can follow a calibration.
+ *   Timers run on the core timer extended to 64 bits, so they never wrap.
  */
 
 #ifndef SW_TIMER_H
@@ -29,11 +34,16 @@
 
 
 #define SW_TIMER(LEN) ((sw_timer_t){ 0, 0, (LEN), false })
-#define NS_TIMER(LEN) ((ns_timer_t){ 0, 0, (LEN), false })
+#define NS_TIMER(LEN) ((ns_timer_t){ 0, 0, SWT_NS_TICKS(LEN), false })  // LEN in ns
 
 #define SWT_COUNTS_MS (CORE_TIMER_FREQUENCY / 1000)
 #define SWT_COUNTS_NS ((double)(CORE_TIMER_FREQUENCY) / 1000000000.0)
-#define SWT_ROLLOVER_MS (UINT32_MAX / SWT_COUNTS_MS)
+
+// Nominal core timer ticks in a duration, as integers. Constant folded for
+// literals, and exact to a tick below 384 s.
+#define SWT_NS_TICKS(NS) (((uint64_t)(NS) * CORE_TIMER_FREQUENCY) / 1000000000U)
+#define SWT_US_TICKS(US) (((uint64_t)(US) * CORE_TIMER_FREQUENCY) / 1000000U)
+#define SWT_MS_TICKS(MS) ((uint64_t)(MS) * SWT_COUNTS_MS)
 
 #define __delay_ms CORETIMER_DelayMs
 #define __delay_us CORETIMER_DelayUs
@@ -47,8 +57,8 @@ extern "C"
 
 typedef struct
 {
-	uint32_t _start;  // time timer was reset at - do not set manually
-	uint32_t _pause;  // time timer was paused at - do not set manually
+	uint64_t _start;  // time timer was reset at - do not set manually
+	uint64_t _pause;  // time timer was paused at - do not set manually
 	uint32_t length;  // period in ms, 0 is convention for use as capture
 	bool running;  // Delta is between start and now if true, else between start and pause
 }
@@ -57,25 +67,31 @@ sw_timer_t;
 
 typedef struct
 {
-	uint32_t _start;  // time timer was reset at - do not set manually
-	uint32_t _pause;  // time timer was paused at - do not set manually
-	double length;  // period in ns, 0 is convention for use as capture
+	uint64_t _start;  // time timer was reset at - do not set manually
+	uint64_t _pause;  // time timer was paused at - do not set manually
+	uint64_t length;  // period in ticks, 0 is convention for use as capture
 	bool running;  // Delta is between start and now if true, else between start and pause
 }
 ns_timer_t;
 
 
-// No initialization needed!
-uint32_t sw_timer_elapsed (sw_timer_t* timer);
-double ns_timer_elapsed (ns_timer_t* timer);
-double ns_time_delta (uint32_t ticks_start, uint32_t ticks_end);
+// No initialization needed! The extended core timer only has to be read,
+// through any timer call, at least once per 32-bit wrap (89 s at 48 MHz),
+// which polling from the superloop always does. Not for use from ISRs.
+uint64_t sw_timer_ticks64 (void);
+uint64_t sw_timer_elapsed_ticks (sw_timer_t* timer);
+uint32_t sw_timer_elapsed (sw_timer_t* timer);  // saturates at UINT32_MAX
+uint64_t ns_timer_elapsed_ticks (ns_timer_t* timer);
+double ns_timer_elapsed (ns_timer_t* timer);  // ns, for presentation
 
+// Ticks, whole or fractional, to calibrated nanoseconds or seconds. One
+// multiply each.
+double sw_timer_ticks_ns (double ticks);
+double sw_timer_ticks_s (double ticks);
+
+void sw_timer_set_scale (double scale);
+double sw_timer_scale (void);
 
-static inline uint32_t
-sw_timer_time (void)
-{
-	return __builtin_mfc0(_CP0_COUNT, _CP0_COUNT_SELECT) / SWT_COUNTS_MS;
-}
 
 static inline uint32_t
 sw_timer_ticks (void)
@@ -83,24 +99,33 @@ sw_timer_ticks (void)
 	return __builtin_mfc0(_CP0_COUNT, _CP0_COUNT_SELECT);
 }
 
+static inline uint64_t
+sw_timer_time (void)
+{
+	// Milliseconds since start up. A 64-bit divide, so only for slow paths,
+	// such as logging. Time with sw_timer_t or ticks instead.
+	return sw_timer_ticks64() / SWT_COUNTS_MS;
+}
+
 
 static inline bool
 sw_timer_expired (sw_timer_t* timer)
 {
-	return sw_timer_elapsed(timer) > timer->length;
+	// Compared in ticks, so there's no division.
+	return sw_timer_elapsed_ticks(timer) > ((uint64_t)timer->length * SWT_COUNTS_MS);
 }
 
 static inline void
 sw_timer_reset (sw_timer_t* timer)
 {
-	timer->_start = sw_timer_time();
+	timer->_start = sw_timer_ticks64();
 	timer->running = true;
 }
 
 static inline void
 sw_timer_pause (sw_timer_t* timer)
 {
-	timer->_pause = sw_timer_time();
+	timer->_pause = sw_timer_ticks64();
 	timer->running = false;
 }
 
@@ -108,20 +133,20 @@ sw_timer_pause (sw_timer_t* timer)
 static inline bool
 ns_timer_expired (ns_timer_t* timer)
 {
-	return ns_timer_elapsed(timer) > timer->length;
+	return ns_timer_elapsed_ticks(timer) > timer->length;
 }
 
 static inline void
 ns_timer_reset (ns_timer_t* timer)
 {
-	timer->_start = sw_timer_ticks();
+	timer->_start = sw_timer_ticks64();
 	timer->running = true;
 }
 
 static inline void
 ns_timer_pause (ns_timer_t* timer)
 {
-	timer->_pause = sw_timer_ticks();
+	timer->_pause = sw_timer_ticks64();
 	timer->running = false;
 }
 
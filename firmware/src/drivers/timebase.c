@@ -0,0 +1,406 @@
+/*
+ * Timebase Calibration
+ *
+ * @file
+ *   timebase.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Disciplines the core timer against a known reference frequency on
+ *   REF_PIC. Each counter result of the reference updates a runtime
+ *   correction, which sw_timer applies to every tick to time conversion. A
+ *   quadratic model of the core timer error against die temperature, learned
+ *   against the same reference, corrects each measurement on top of that.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "die_temp.h"
+#include "sw_timer.h"
+
+#include "timebase.h"
+
+
+static double ref;
+static uint32_t samples;
+static tb_state_t state;
+
+// The scale sw_timer applies is scale_ref * (1 + temp_ppb), so disciplining
+// and the temperature model each track their own part of the error.
+static double scale_ref;
+static double temp_ppb;
+static double model[TB_MODEL_TERMS];
+static bool model_on;
+static bool learning;
+static tb_fit_t learn_fit;
+
+
+static void
+apply_scale (void)
+{
+	sw_timer_set_scale(scale_ref * (1.0 + (temp_ppb / 1000000000.0)));
+}
+
+void
+timebase_init (void)
+{
+	unsigned int i;
+
+	ref = 0.0;
+	samples = 0;
+	state = TB_OFF;
+	scale_ref = 1.0;
+	temp_ppb = 0.0;
+	model_on = false;
+	learning = false;
+	tb_fit_reset(&learn_fit);
+
+	for (i = 0; i < TB_MODEL_TERMS; i++)
+	{
+		model[i] = 0.0;
+	}
+
+	apply_scale();
+}
+
+void
+timebase_set_reference (double ref_hz)
+{
+	// Start acquiring from the correction held so far.
+	ref = (ref_hz > 0.0) ? ref_hz : 0.0;
+	samples = 0;
+
+	if (learning)
+	{
+		state = TB_LEARNING;
+	}
+	else
+	{
+		state = (ref > 0.0) ? TB_ACQUIRING : TB_OFF;
+	}
+}
+
+double
+timebase_reference (void)
+{
+	return ref;
+}
+
+void
+timebase_update (double freq_hz)
+{
+	double err, gain;
+
+	if (ref <= 0.0)
+	{
+		return;
+	}
+
+	// The result is off by the residual timebase error: a fast core timer
+	// makes the reference look slow.
+	err = (freq_hz / ref) - 1.0;
+
+	if (fabs(err) > TB_ERROR_MAX)
+	{
+		state = TB_FAULT;
+
+		return;
+	}
+
+	samples++;
+
+	if (learning)
+	{
+		// The error left once disciplining is taken out is what the model
+		// has to explain. Disciplining is held, or it would absorb it.
+		if (die_temp_valid())
+		{
+			double resid = ((1.0 + (temp_ppb / 1000000000.0)) / (1.0 + err)) - 1.0;
+
+			tb_fit_add(&learn_fit, die_temp_c(), resid * 1000000000.0);
+		}
+
+		state = TB_LEARNING;
+
+		return;
+	}
+
+	// Running mean over the first results, then a first-order low-pass, so
+	// the correction settles fast and then averages down the gate noise.
+	gain = 1.0 / (double)((samples < TB_AVG_RESULTS) ? samples : TB_AVG_RESULTS);
+	scale_ref *= 1.0 + (gain * ((1.0 / (1.0 + err)) - 1.0));
+	apply_scale();
+
+	state = (samples >= TB_LOCK_RESULTS) ? TB_LOCKED : TB_ACQUIRING;
+}
+
+void
+timebase_set_ppb (double ppb)
+{
+	scale_ref = 1.0 + (ppb / 1000000000.0);
+	apply_scale();
+}
+
+double
+timebase_ppb (void)
+{
+	return (scale_ref - 1.0) * 1000000000.0;
+}
+
+tb_state_t
+timebase_state (void)
+{
+	return state;
+}
+
+uint32_t
+timebase_samples (void)
+{
+	return samples;
+}
+
+void
+timebase_compensate (void)
+{
+	// Hold the last correction while there's no temperature reading.
+	if (!model_on || !die_temp_valid())
+	{
+		return;
+	}
+
+	temp_ppb = timebase_model_ppb(model, die_temp_c());
+	apply_scale();
+}
+
+double
+timebase_temp_ppb (void)
+{
+	return temp_ppb;
+}
+
+void
+timebase_set_learning (bool enable)
+{
+	double coef[TB_MODEL_TERMS];
+
+	if (enable && !learning)
+	{
+		tb_fit_reset(&learn_fit);
+	}
+	else if (!enable && learning && tb_fit_solve(&learn_fit, coef))
+	{
+		// The fit is of the error left over with the old model applied, so it
+		// replaces the model rather than adding to it.
+		timebase_set_model(coef);
+	}
+
+	learning = enable;
+	samples = 0;
+
+	if (learning)
+	{
+		state = TB_LEARNING;
+	}
+	else
+	{
+		state = (ref > 0.0) ? TB_ACQUIRING : TB_OFF;
+	}
+}
+
+bool
+timebase_learning (void)
+{
+	return learning;
+}
+
+void
+timebase_set_model (const double* coef)
+{
+	unsigned int i;
+
+	model_on = false;
+
+	for (i = 0; i < TB_MODEL_TERMS; i++)
+	{
+		model[i] = coef[i];
+
+		if (0.0 != coef[i])
+		{
+			model_on = true;
+		}
+	}
+
+	if (!model_on)
+	{
+		temp_ppb = 0.0;
+		apply_scale();
+	}
+	else
+	{
+		timebase_compensate();
+	}
+}
+
+void
+timebase_model (double* coef)
+{
+	unsigned int i;
+
+	for (i = 0; i < TB_MODEL_TERMS; i++)
+	{
+		coef[i] = model[i];
+	}
+}
+
+double
+timebase_model_ppb (const double* coef, double temp_c)
+{
+	double dt = temp_c - TB_TEMP_REF;
+
+	return coef[0] + (dt * (coef[1] + (dt * coef[2])));
+}
+
+
+void
+tb_fit_reset (tb_fit_t* fit)
+{
+	unsigned int i;
+
+	fit->n = 0;
+	fit->temp_min = 0.0;
+	fit->temp_max = 0.0;
+
+	for (i = 0; i < ((2 * TB_MODEL_TERMS) - 1); i++)
+	{
+		fit->sx[i] = 0.0;
+	}
+
+	for (i = 0; i < TB_MODEL_TERMS; i++)
+	{
+		fit->sxy[i] = 0.0;
+	}
+}
+
+void
+tb_fit_add (tb_fit_t* fit, double temp_c, double ppb)
+{
+	double dt = temp_c - TB_TEMP_REF;
+	double p = 1.0;
+	unsigned int i;
+
+	if ((0 == fit->n) || (temp_c < fit->temp_min))
+	{
+		fit->temp_min = temp_c;
+	}
+
+	if ((0 == fit->n) || (temp_c > fit->temp_max))
+	{
+		fit->temp_max = temp_c;
+	}
+
+	fit->n++;
+
+	for (i = 0; i < ((2 * TB_MODEL_TERMS) - 1); i++)
+	{
+		if (i < TB_MODEL_TERMS)
+		{
+			fit->sxy[i] += p * ppb;
+		}
+
+		fit->sx[i] += p;
+		p *= dt;
+	}
+}
+
+bool
+tb_fit_solve (const tb_fit_t* fit, double* coef)
+{
+	// Normal equations A c = b, with A[r][k] = sum(dT^(r+k)) and
+	// b[r] = sum(dT^r * ppb), solved by Gaussian elimination over as many
+	// terms as the temperature span supports.
+	double a[TB_MODEL_TERMS][TB_MODEL_TERMS + 1];
+	double span = fit->temp_max - fit->temp_min;
+	unsigned int terms = 1;
+	unsigned int r, k, i;
+
+	for (i = 0; i < TB_MODEL_TERMS; i++)
+	{
+		coef[i] = 0.0;
+	}
+
+	if (0 == fit->n)
+	{
+		return false;
+	}
+
+	while ((terms < TB_MODEL_TERMS) && (terms < fit->n) && (span >= ((double)terms * TB_TEMP_SPAN_MIN)))
+	{
+		terms++;
+	}
+
+	for (;;)
+	{
+		bool singular = false;
+
+		for (r = 0; r < terms; r++)
+		{
+			for (k = 0; k < terms; k++)
+			{
+				a[r][k] = fit->sx[r + k];
+			}
+
+			a[r][terms] = fit->sxy[r];
+		}
+
+		// A is symmetric positive definite for distinct points, so no
+		// pivoting is needed - a vanishing pivot means too few distinct
+		// temperatures for this many terms.
+		for (i = 0; (i < terms) && !singular; i++)
+		{
+			if (fabs(a[i][i]) < (1e-12 * fit->sx[0]))
+			{
+				singular = true;
+
+				break;
+			}
+
+			for (r = i + 1; r < terms; r++)
+			{
+				double f = a[r][i] / a[i][i];
+
+				for (k = i; k <= terms; k++)
+				{
+					a[r][k] -= f * a[i][k];
+				}
+			}
+		}
+
+		if (!singular)
+		{
+			break;
+		}
+
+		terms--;
+	}
+
+	for (i = terms; i > 0; i--)
+	{
+		double sum = a[i - 1][terms];
+
+		for (k = i; k < terms; k++)
+		{
+			sum -= a[i - 1][k] * coef[k];
+		}
+
+		coef[i - 1] = sum / a[i - 1][i - 1];
+	}
+
+	return true;
+}
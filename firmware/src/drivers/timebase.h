@@ -0,0 +1,108 @@
+/*
+ * Timebase Calibration
+ *
+ * @file
+ *   timebase.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Disciplines the core timer against a known reference frequency on
+ *   REF_PIC. Each counter result of the reference updates a runtime
+ *   correction, which sw_timer applies to every tick to time conversion. A
+ *   quadratic model of the core timer error against die temperature, learned
+ *   against the same reference, corrects each measurement on top of that.
+ */
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define TB_AVG_RESULTS (16U)  // filter time constant, in counter results
+#define TB_LOCK_RESULTS (8U)  // results before the correction is trusted
+#define TB_ERROR_MAX (500e-6)  // larger fractional errors aren't the reference
+
+#define TB_MODEL_TERMS (3U)  // ppb = c0 + c1 * dT + c2 * dT^2
+#define TB_TEMP_REF (25.0)  // C, dT = 0
+#define TB_TEMP_SPAN_MIN (2.0)  // C, learnt span needed per fitted term past c0
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef enum
+{
+	TB_OFF = 0,  // no reference, correction held
+	TB_ACQUIRING,
+	TB_LOCKED,
+	TB_FAULT,  // latest result too far from the reference to be it
+	TB_LEARNING,  // fitting the temperature model instead of disciplining
+}
+tb_state_t;
+
+// Least-squares fit of TB_MODEL_TERMS coefficients to (temp_c, ppb) points,
+// as running sums so no history is kept. Fewer terms are fitted, and the rest
+// zeroed, when the temperature span can't support them.
+typedef struct
+{
+	uint32_t n;
+	double sx[(2 * TB_MODEL_TERMS) - 1];  // sum of dT^k
+	double sxy[TB_MODEL_TERMS];  // sum of dT^k * ppb
+	double temp_min;
+	double temp_max;
+}
+tb_fit_t;
+
+
+void timebase_init (void);
+
+// Reference frequency on REF_PIC, e.g. 1 Hz for 1PPS or 10 MHz. Zero stops
+// disciplining, and the correction reached so far is held.
+void timebase_set_reference (double ref_hz);
+double timebase_reference (void);
+
+// Feed a counter result of the reference, measured with the current
+// correction applied.
+void timebase_update (double freq_hz);
+
+// Core timer error from disciplining, as measured or restored by the host,
+// not counting the temperature correction. Positive is fast.
+void timebase_set_ppb (double ppb);
+double timebase_ppb (void);
+
+tb_state_t timebase_state (void);
+uint32_t timebase_samples (void);
+
+// Bring the temperature correction up to date. Call before each measurement.
+void timebase_compensate (void);
+double timebase_temp_ppb (void);  // temperature correction in use
+
+// Learning fits the model to the reference results, in place of disciplining.
+// Stopping replaces the model with the fit, if there were any results.
+void timebase_set_learning (bool enable);
+bool timebase_learning (void);
+
+void timebase_set_model (const double* coef);  // TB_MODEL_TERMS, all zero is off
+void timebase_model (double* coef);
+double timebase_model_ppb (const double* coef, double temp_c);
+
+void tb_fit_reset (tb_fit_t* fit);
+void tb_fit_add (tb_fit_t* fit, double temp_c, double ppb);
+bool tb_fit_solve (const tb_fit_t* fit, double* coef);  // false if no points
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMEBASE_H */
@@ -11,22 +11,29 @@
  *   Copyright 2021 Frequencer Team
  *
  * @brief
- *   Modbus ASCII driver, backed by Harmony console.
+ *   Modbus ASCII, RTU or MBAP driver, backed by Harmony console.
  *   This only implements a subset of functions, relating to reading/writing the
  *   holding registers.
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "../drivers/hang_here.h"
+#include "definitions.h"
 
 #include "modbus.h"
 #include "modbus_con_ascii.h"
+#include "modbus_con_mbap.h"
+#include "modbus_con_rtu.h"
 #include "modbus_defs.h"
 #include "modbus_pdu.h"
 
 
+#define RX_BLOCK (64U)  // console bytes read per call
+
+
 static enum
 {
 	CMD_NONE = 0,
@@ -35,6 +42,44 @@ static enum
 }
 command;
 
+// Frame layer, behind the same PDU interface for each framing.
+typedef struct
+{
+	void (* init)(void);
+	size_t (* rx)(const char* in, size_t count);
+	void (* overflow)(void);
+	bool (* idle)(void);
+	modbus_pdu_t (* parse_adu)(void);
+	void (* send_reply)(modbus_pdu_t* pdu);
+	void (* done)(void);
+}
+transport_ops_t;
+
+static const transport_ops_t transports[] = {
+	[MB_TRANSPORT_ASCII] = {
+		mca_init, mca_rx, mca_overflow, mca_idle,
+		mca_parse_adu, mca_send_reply, mca_done,
+	},
+	[MB_TRANSPORT_RTU] = {
+		mcr_init, mcr_rx, mcr_overflow, mcr_idle,
+		mcr_parse_adu, mcr_send_reply, mcr_done,
+	},
+	[MB_TRANSPORT_MBAP] = {
+		mcm_init, mcm_rx, mcm_overflow, mcm_idle,
+		mcm_parse_adu, mcm_send_reply, mcm_done,
+	},
+};
+
+static mb_transport_t transport;
+static bool transport_auto;
+static mb_transport_t mode_next;  // applied once the current reply is out
+static bool mode_pending;
+static const transport_ops_t* tp;
+static char rx_block[RX_BLOCK];
+static size_t rx_pos;  // of the first byte the transport hasn't taken yet
+static size_t rx_len;
+static bool rx_held;  // the last pass left input waiting on full frame slots
+
 static mb_handled_regs_t write_handlers[MODBUS_MAX_REG_HANDLERS];
 static mb_handled_regs_t read_handlers[MODBUS_MAX_REG_HANDLERS];
 
@@ -42,6 +87,9 @@ static modbus_pdu_t pdu;
 static mb_reg_data_t reg_data = { 0 };
 
 
+static void rx_task (void);
+static void select_transport (mb_transport_t new_transport);
+static void apply_mode (mb_transport_t mode);
 static void parse_pdu (void);
 static void run_command (void);
 static mb_reg_handler_t get_handler (mb_reg_data_t* reg_data, mb_handled_regs_t* list);
@@ -60,7 +108,16 @@ modbus_init (void)
 	reg_data.address = 0;
 	reg_data.count = 0;
 
+	transport = MB_TRANSPORT_ASCII;
+	transport_auto = true;
+	mode_pending = false;
+	rx_pos = 0;
+	rx_len = 0;
+	rx_held = false;
+	tp = &transports[transport];
 	mca_init();
+	mcr_init();
+	mcm_init();
 
 	for (i = 0; i < MODBUS_MAX_REG_HANDLERS; i++)
 	{
@@ -72,18 +129,57 @@ modbus_init (void)
 void
 modbus_task (void)
 {
-	mca_task();
+	rx_task();
 
-	pdu = mca_parse_adu();
+	pdu = tp->parse_adu();
 
 	if ((pdu.length > 0) && (NULL != pdu.data))
 	{
 		parse_pdu();
 		run_command();
-		mca_send_reply(&pdu);
+		tp->send_reply(&pdu);
+	}
+
+	tp->done();
+
+	if (mode_pending)
+	{
+		mode_pending = false;
+		apply_mode(mode_next);
+	}
+}
+
+bool
+modbus_set_transport (mb_transport_t mode)
+{
+	if (mode > MB_TRANSPORT_MBAP)
+	{
+		return false;
+	}
+
+	// Not until the end of modbus_task(), so a request that changes the
+	// framing still gets its reply in the old one.
+	mode_next = mode;
+	mode_pending = true;
+
+	return true;
+}
+
+mb_transport_t
+modbus_transport (void)
+{
+	return transport;
+}
+
+mb_transport_t
+modbus_transport_mode (void)
+{
+	if (mode_pending)
+	{
+		return mode_next;
 	}
 
-	mca_done();
+	return transport_auto ? MB_TRANSPORT_AUTO : transport;
 }
 
 
@@ -160,6 +256,110 @@ modbus_add_reg_handler (
 }
 
 
+static void
+rx_task (void)
+{
+	ssize_t count, free;
+	size_t used;
+
+	free = SYS_CONSOLE_ReadFreeBufferCountGet(sysObj.sysConsole0);
+
+	// A console buffer that filled up behind full frame slots is only holding
+	// the host back. Otherwise it filled faster than it was read, and the
+	// console has dropped what didn't fit.
+	if ((free == 0) && !rx_held)
+	{
+		tp->overflow();
+	}
+	else if (free < 0)
+	{
+		HANG_HERE();
+	}
+
+	rx_held = false;
+
+	while (true)
+	{
+		if (rx_pos >= rx_len)
+		{
+			count = SYS_CONSOLE_Read(sysObj.sysConsole0, rx_block, RX_BLOCK);
+
+			if (count < 0)
+			{
+				HANG_HERE();
+			}
+
+			if (count < 1)
+			{
+				break;
+			}
+
+			rx_pos = 0;
+			rx_len = count;
+		}
+
+		// An ASCII frame always starts with a colon, and an RTU frame with the
+		// address, so the first byte after an idle line tells them apart.
+		if (transport_auto && tp->idle())
+		{
+			select_transport((CMB_ASF_START == rx_block[rx_pos]) ? MB_TRANSPORT_ASCII : MB_TRANSPORT_RTU);
+		}
+
+		used = tp->rx(&rx_block[rx_pos], rx_len - rx_pos);
+		rx_pos += used;
+
+		if (0 == used)
+		{
+			// Every frame slot is full. The rest waits here, and then in the
+			// console buffer, until replies free one up.
+			rx_held = true;
+			break;
+		}
+	}
+}
+
+static void
+select_transport (mb_transport_t new_transport)
+{
+	if (new_transport == transport)
+	{
+		return;
+	}
+
+	transport = new_transport;
+	tp = &transports[transport];
+	tp->init();
+}
+
+static void
+apply_mode (mb_transport_t mode)
+{
+	switch (mode)
+	{
+		case MB_TRANSPORT_AUTO:
+		{
+			transport_auto = true;
+
+			break;
+		}
+
+		case MB_TRANSPORT_ASCII:
+		case MB_TRANSPORT_RTU:
+		case MB_TRANSPORT_MBAP:
+		{
+			transport_auto = false;
+			select_transport(mode);
+
+			break;
+		}
+
+		default:
+		{
+			HANG_HERE();
+		}
+	}
+}
+
 static void
 parse_pdu (void)
 {
@@ -11,7 +11,7 @@
  *   Copyright 2021 Frequencer Team
  *
  * @brief
- *   Modbus ASCII driver, backed by Harmony console.
+ *   Modbus ASCII, RTU or MBAP driver, backed by Harmony console.
  *   This only implements a subset of functions, relating to reading/writing the
  *   holding registers.
  */
@@ -23,7 +23,7 @@
 #include "modbus_defs.h"
 
 
-#define MODBUS_MAX_REG_HANDLERS (3U)
+#define MODBUS_MAX_REG_HANDLERS (12U)
 
 
 #ifdef  __cplusplus
@@ -38,6 +38,15 @@ typedef enum
 }
 mb_reg_action_t;
 
+typedef enum
+{
+	MB_TRANSPORT_AUTO,  // ASCII or RTU, from the first byte of each frame
+	MB_TRANSPORT_ASCII,
+	MB_TRANSPORT_RTU,
+	MB_TRANSPORT_MBAP,  // never auto-detected, its first byte could be anything
+}
+mb_transport_t;
+
 
 typedef struct
 {
@@ -61,6 +70,11 @@ mb_handled_regs_t;
 void modbus_init (void);
 void modbus_task (void);
 
+// Takes effect after the current request's reply. False if out of range.
+bool modbus_set_transport (mb_transport_t mode);
+mb_transport_t modbus_transport (void);  // the one in use, never AUTO
+mb_transport_t modbus_transport_mode (void);  // as set
+
 void modbus_add_reg_handler (
 	uint16_t address,
 	uint16_t count,
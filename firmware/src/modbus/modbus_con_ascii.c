@@ -28,6 +28,8 @@
 
 #define PDU_EMPTY ((modbus_pdu_t){ .data = NULL, .length = 0 })
 
+#define HEX_VALID (0x10U)  // set in hex_lut for hex digits, over the value
+
 
 static enum
 {
@@ -36,107 +38,163 @@ static enum
 	AS_MSNIB = 20,
 	AS_LSNIB = 30,
 	AS_END_CR = 40,
-	AS_READY = 50,
+	AS_FULL = 50,
 }
 ascii_state;
 
 
-uint8_t adu_data[MCA_FRAME_MAX] = { 0 };
-mca_adu_t adu;
+// Received frames queue up in slots, oldest at tx_slot, and are replied to
+// in order. rx_adu is the slot being received into.
+static uint8_t adu_data[MCA_RX_SLOTS][MCA_FRAME_MAX] = { { 0 } };
+static mca_adu_t slots[MCA_RX_SLOTS];
+static uint8_t slot_lrc[MCA_RX_SLOTS];
+static unsigned int slot_seq[MCA_RX_SLOTS];
+static unsigned int rx_slot;
+static unsigned int tx_slot;
+static unsigned int slots_ready;
+static bool taken;  // the frame at tx_slot is with mca_parse_adu's caller
+static mca_adu_t* rx_adu;
 
 static unsigned int dbg_seq;
 static unsigned int dbg_char;
 
+static char tx_frame[MCA_REPLY_MAX];
+static uint8_t lrc_sum;  // of the frame bytes so far, LRC included
+
+static const uint8_t hex_lut[256] = {
+	['0'] = HEX_VALID | 0x0, ['1'] = HEX_VALID | 0x1,
+	['2'] = HEX_VALID | 0x2, ['3'] = HEX_VALID | 0x3,
+	['4'] = HEX_VALID | 0x4, ['5'] = HEX_VALID | 0x5,
+	['6'] = HEX_VALID | 0x6, ['7'] = HEX_VALID | 0x7,
+	['8'] = HEX_VALID | 0x8, ['9'] = HEX_VALID | 0x9,
+	['A'] = HEX_VALID | 0xA, ['B'] = HEX_VALID | 0xB,
+	['C'] = HEX_VALID | 0xC, ['D'] = HEX_VALID | 0xD,
+	['E'] = HEX_VALID | 0xE, ['F'] = HEX_VALID | 0xF,
+	['a'] = HEX_VALID | 0xA, ['b'] = HEX_VALID | 0xB,
+	['c'] = HEX_VALID | 0xC, ['d'] = HEX_VALID | 0xD,
+	['e'] = HEX_VALID | 0xE, ['f'] = HEX_VALID | 0xF,
+};
+
+static size_t ascii_frame_run (const char* in, size_t count);
 static void ascii_frame_sm (char in);
 static bool decode_hex (char in, uint8_t* out);
-static bool con_write_safe (const char* fmt, ...);
+static size_t encode_frame (char* out, const mca_adu_t* adu);
+static void commit_frame (void);
 
 static bool validate_lrc (mca_adu_t* adu);
-static uint8_t calculate_lrc (mca_adu_t* adu);
-static void update_lrc (mca_adu_t* adu);
 
 
 void
 mca_init (void)
 {
+	unsigned int i;
+
 	ascii_state = AS_IDLE;
 
-	adu.data = adu_data;
-	adu.length = 0;
+	for (i = 0; i < MCA_RX_SLOTS; i++)
+	{
+		slots[i].data = adu_data[i];
+		slots[i].length = 0;
+		slot_lrc[i] = 0;
+		slot_seq[i] = 0;
+	}
+
+	rx_slot = 0;
+	tx_slot = 0;
+	slots_ready = 0;
+	taken = false;
+	rx_adu = &slots[rx_slot];
+	lrc_sum = 0;
 
 	dbg_seq = 0;
 	dbg_char = 0;
 }
 
 
-void
-mca_task (void)
+size_t
+mca_rx (const char* in, size_t count)
 {
-	char in;
-	ssize_t count, free;
+	size_t i = 0;
 
-	free = SYS_CONSOLE_ReadFreeBufferCountGet(sysObj.sysConsole0);
-
-	if (free == 0)
+	// Hex pairs are decoded in runs, and framing characters, errors and
+	// anything else go through the state machine one at a time. Stops once
+	// every slot holds a frame, leaving the rest with the caller.
+	while ((i < count) && (AS_FULL != ascii_state))
 	{
-		if (AS_READY == ascii_state)
-		{
-			mb_debug("RX buffer overflow, ignoring.");
-		}
-		else
+		i += ascii_frame_run(&in[i], count - i);
+
+		if (i < count)
 		{
-			mb_debug("RX buffer overflow, resetting.");
-			ascii_state = AS_IDLE;
+			ascii_frame_sm(in[i]);
+			i++;
 		}
 	}
-	else if (free < 0)
+
+	return i;
+}
+
+void
+mca_overflow (void)
+{
+	if (AS_FULL == ascii_state)
 	{
-		HANG_HERE();
+		mb_debug("RX buffer overflow, ignoring.");
 	}
-
-	while (true)
+	else
 	{
-		count = SYS_CONSOLE_Read(sysObj.sysConsole0, &in, 1);
-
-		if (count < 0)
-		{
-			HANG_HERE();
-		}
-
-		if (count < 1)
-		{
-			break;
-		}
-
-		ascii_frame_sm(in);
+		mb_debug("RX buffer overflow, resetting.");
+		ascii_state = AS_IDLE;
 	}
 }
 
+bool
+mca_idle (void)
+{
+	return (AS_IDLE == ascii_state) && (0 == slots_ready);
+}
+
 
 modbus_pdu_t
 mca_parse_adu (void)
 {
-	if (AS_READY != ascii_state)
+	mca_adu_t* adu = &slots[tx_slot];
+	ssize_t free;
+
+	if (0 == slots_ready)
 	{
-		// Frame not fully received.
+		// No frame fully received.
 		return PDU_EMPTY;
 	}
 
-	if (adu.length < 3)
+	// Leave the frame queued until its reply is sure to fit.
+	free = SYS_CONSOLE_WriteFreeBufferCountGet(sysObj.sysConsole0);
+
+	if (free < 0)
+	{
+		HANG_HERE();
+	}
+	else if ((size_t)free < MCA_REPLY_MAX)
+	{
+		return PDU_EMPTY;
+	}
+
+	taken = true;
+
+	if (adu->length < 3)
 	{
 		mb_debug("Ignoring too-short frame.");
 
 		return PDU_EMPTY;
 	}
 
-	if (MODBUS_ADDRESS != adu.data[0])
+	if (MODBUS_ADDRESS != adu->data[0])
 	{
-		mb_debug("Ignoring frame with wrong address %d.", adu.data[0]);
+		mb_debug("Ignoring frame with wrong address %d.", adu->data[0]);
 
 		return PDU_EMPTY;
 	}
 
-	if (!validate_lrc(&adu))
+	if (!validate_lrc(adu))
 	{
 		mb_debug("Ignoring frame with wrong LRC.");
 
@@ -144,65 +202,64 @@ mca_parse_adu (void)
 	}
 
 	return (modbus_pdu_t){
-			   .data = &(adu.data[1]),
-			   .length = adu.length - 2,
+			   .data = &(adu->data[1]),
+			   .length = adu->length - 2,
 	};
 }
 
 void
 mca_send_reply (modbus_pdu_t* pdu)
 {
-	unsigned int i = 0;
+	mca_adu_t* adu = &slots[tx_slot];
+	size_t count;
+	ssize_t free;
 
 	if (NULL == pdu)
 	{
-		adu.length = 0;
+		adu->length = 0;
 
 		return;
 	}
 
 	if (pdu->length <= 0)
 	{
-		adu.length = 0;
+		adu->length = 0;
 
 		return;
 	}
 
-	adu.length = pdu->length + 2;
+	adu->length = pdu->length + 2;
 
-	if (adu.length > MCA_FRAME_MAX)
+	if (adu->length > MCA_FRAME_MAX)
 	{
 		mb_debug("Overlength reply, won't send.");
-		adu.length = 0;
+		adu->length = 0;
 
 		return;
 	}
 
-	adu.data[0] = MODBUS_ADDRESS;
-	update_lrc(&adu);
+	adu->data[0] = MODBUS_ADDRESS;
 
-	if (!con_write_safe(":"))
-	{
-		adu.length = 0;
+	// The whole frame goes in one write, or not at all, so the host never
+	// sees a partial one.
+	count = encode_frame(tx_frame, adu);
+	free = SYS_CONSOLE_WriteFreeBufferCountGet(sysObj.sysConsole0);
 
-		return;
+	if (free < 0)
+	{
+		HANG_HERE();
 	}
-
-	while (i < adu.length)
+	else if ((size_t)free < count)
 	{
-		if (!con_write_safe("%02X", adu.data[i]))
-		{
-			adu.length = 0;
-
-			return;
-		}
+		mb_debug("TX overflow, discarding reply.");
+		adu->length = 0;
 
-		i++;
+		return;
 	}
 
-	con_write_safe("\r\n");
+	SYS_CONSOLE_Write(sysObj.sysConsole0, tx_frame, count);
 
-	adu.length = 0;
+	adu->length = 0;
 }
 
 // Call this function when you are done with the result of mca_parse_adu.
@@ -210,7 +267,17 @@ mca_send_reply (modbus_pdu_t* pdu)
 void
 mca_done (void)
 {
-	if (AS_READY == ascii_state)
+	if (!taken)
+	{
+		return;
+	}
+
+	taken = false;
+	slots[tx_slot].length = 0;
+	tx_slot = (tx_slot + 1) % MCA_RX_SLOTS;
+	slots_ready--;
+
+	if (AS_FULL == ascii_state)
 	{
 		ascii_state = AS_IDLE;
 	}
@@ -220,6 +287,7 @@ mca_done (void)
 void
 mb_debug (const char* fmt, ...)
 {
+	mca_adu_t* adu = rx_adu;
 	char buf[100];
 	unsigned int i;
 
@@ -229,12 +297,13 @@ mb_debug (const char* fmt, ...)
 	vsnprintf(buf, 100, fmt, args);
 	va_end(args);
 
-	if (AS_READY == ascii_state)
+	if (taken)
 	{
+		adu = &slots[tx_slot];
 		printf(
 			"MCA: Function warning. Frame %d, function %d.\r\n",
-			dbg_seq,
-			adu.data[1]
+			slot_seq[tx_slot],
+			adu->data[1]
 		);
 	}
 	else
@@ -247,13 +316,13 @@ mb_debug (const char* fmt, ...)
 		);
 	}
 
-	if (adu.length > 0)
+	if (adu->length > 0)
 	{
 		printf("MCA: Frame data: ");
 
-		for (i = 0; (i < adu.length) && (i < MCA_FRAME_MAX); i++)
+		for (i = 0; (i < adu->length) && (i < MCA_FRAME_MAX); i++)
 		{
-			printf("%02X", adu.data[i]);
+			printf("%02X", adu->data[i]);
 		}
 
 		printf("\r\n");
@@ -263,28 +332,60 @@ mb_debug (const char* fmt, ...)
 }
 
 
+// Decodes whole hex pairs mid-frame straight into the ADU, and returns the
+// characters consumed. Stops short of anything ascii_frame_sm has to see,
+// including a pair split across reads and a full frame.
+static size_t
+ascii_frame_run (const char* in, size_t count)
+{
+	size_t i = 0;
+
+	if ((AS_START != ascii_state) && (AS_LSNIB != ascii_state))
+	{
+		return 0;
+	}
+
+	while (((i + 1) < count) && (rx_adu->length < MCA_FRAME_MAX))
+	{
+		uint8_t ms = hex_lut[(uint8_t)in[i]];
+		uint8_t ls = hex_lut[(uint8_t)in[i + 1]];
+		uint8_t byte;
+
+		if (0 == (ms & ls & HEX_VALID))
+		{
+			break;
+		}
+
+		byte = (uint8_t)((ms << 4) | (ls & 0x0F));
+		rx_adu->data[rx_adu->length] = byte;
+		rx_adu->length++;
+		lrc_sum += byte;
+		i += 2;
+	}
+
+	if (i > 0)
+	{
+		ascii_state = AS_LSNIB;
+		dbg_char += i;
+	}
+
+	return i;
+}
+
 static void
 ascii_frame_sm (char in)
 {
 	dbg_char++;
 
-	if (CMB_ASF_START == in)
+	if ((CMB_ASF_START == in) && (AS_FULL != ascii_state))
 	{
-		if (AS_READY != ascii_state)
+		if (AS_IDLE != ascii_state)
 		{
-			if (AS_IDLE != ascii_state)
-			{
-				mb_debug("Unexpected SOF.");
-			}
-
-			// Reset.
-			ascii_state = AS_IDLE;
-		}
-		else
-		{
-			// Can't handle it now as other mechanisms may be using the data.
-			mb_debug("Ignoring SOF.");
+			mb_debug("Unexpected SOF.");
 		}
+
+		// Reset.
+		ascii_state = AS_IDLE;
 	}
 
 	// Note that ``ascii_state`` is state BEFORE processing...
@@ -293,7 +394,8 @@ ascii_frame_sm (char in)
 	{
 		case AS_IDLE:
 		{
-			adu.length = 0;
+			rx_adu->length = 0;
+			lrc_sum = 0;
 			dbg_char = 0;
 
 			if (CMB_ASF_START == in)
@@ -311,7 +413,7 @@ ascii_frame_sm (char in)
 		{
 			uint8_t nib;
 
-			if (adu.length > MCA_FRAME_MAX)
+			if ((rx_adu->length >= MCA_FRAME_MAX) && (CMB_ASF_END_CR != in))
 			{
 				mb_debug("Overlength frame, resetting.");
 				ascii_state = AS_IDLE;
@@ -343,14 +445,15 @@ ascii_frame_sm (char in)
 			if (AS_MSNIB == ascii_state)
 			{
 				// Current char is LSnib.
-				adu.data[adu.length] |= (nib & 0x0F);
-				adu.length++;
+				rx_adu->data[rx_adu->length] |= (nib & 0x0F);
+				lrc_sum += rx_adu->data[rx_adu->length];
+				rx_adu->length++;
 				ascii_state = AS_LSNIB;
 			}
 			else
 			{
 				// Current char is MSnib.
-				adu.data[adu.length] = (nib << 4);
+				rx_adu->data[rx_adu->length] = (nib << 4);
 				ascii_state = AS_MSNIB;
 			}
 
@@ -361,7 +464,7 @@ ascii_frame_sm (char in)
 		{
 			if (CMB_ASF_END_LF == in)
 			{
-				ascii_state = AS_READY;
+				commit_frame();
 			}
 			else
 			{
@@ -372,9 +475,9 @@ ascii_frame_sm (char in)
 			break;
 		}
 
-		case AS_READY:
+		case AS_FULL:
 		{
-			// Wait.
+			// Wait for mca_done to free a slot.
 
 			break;
 		}
@@ -386,88 +489,66 @@ ascii_frame_sm (char in)
 	}
 }
 
-static bool
-decode_hex (char in, uint8_t* out)
+static void
+commit_frame (void)
 {
-	if ((in >= '0') && (in <= '9'))
-	{
-		*out = in - '0';
-
-		return true;
-	}
-	else if ((in >= 'a') && (in <= 'f'))
-	{
-		*out = (in - 'a') + 10;
-
-		return true;
-	}
-	else if ((in >= 'A') && (in <= 'F'))
-	{
-		*out = (in - 'A') + 10;
-
-		return true;
-	}
-	else
-	{
-		return false;
-	}
+	slot_lrc[rx_slot] = lrc_sum;
+	slot_seq[rx_slot] = dbg_seq;
+	slots_ready++;
+	rx_slot = (rx_slot + 1) % MCA_RX_SLOTS;
+	rx_adu = &slots[rx_slot];
+	ascii_state = (slots_ready < MCA_RX_SLOTS) ? AS_IDLE : AS_FULL;
 }
 
 static bool
-con_write_safe (const char* fmt, ...)
+decode_hex (char in, uint8_t* out)
 {
-	// Note: Don't write more than 100 bytes at a time...
+	uint8_t nib = hex_lut[(uint8_t)in];
 
-	char buf[100];
-	ssize_t free;
-	int written;
-
-	free = SYS_CONSOLE_WriteFreeBufferCountGet(sysObj.sysConsole0);
+	*out = nib & 0x0F;
 
-	if (free < 0)
-	{
-		HANG_HERE();
-	}
-	else if (free < 2)
-	{
-		mb_debug("TX overflow, discarding reply.");
-
-		return false;
-	}
+	return 0 != (nib & HEX_VALID);
+}
 
-	va_list args;
+// Encodes the ADU as a whole ASCII frame, and returns its length. out must
+// hold MCA_REPLY_MAX characters. The LRC is summed on the way, and goes in
+// place of the ADU's last byte.
+static size_t
+encode_frame (char* out, const mca_adu_t* adu)
+{
+	static const char hex_digits[16] = {
+		'0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'A', 'B', 'C', 'D', 'E', 'F',
+	};
+	size_t n = 0;
+	uint8_t sum = 0;
+	uint8_t lrc;
+	unsigned int i;
 
-	va_start(args, fmt);
-	written = vsnprintf(buf, 100, fmt, args);
-	va_end(args);
+	out[n++] = CMB_ASF_START;
 
-	if ((written < 0) || (written > 100))
+	for (i = 0; (i + 1) < adu->length; i++)
 	{
-		HANG_HERE();
+		out[n++] = hex_digits[adu->data[i] >> 4];
+		out[n++] = hex_digits[adu->data[i] & 0x0F];
+		sum += adu->data[i];
 	}
 
-	SYS_CONSOLE_Message(sysObj.sysConsole0, buf);
+	// Two's complement, so the sum over the whole frame is zero.
+	lrc = (uint8_t)(-sum);
+	out[n++] = hex_digits[lrc >> 4];
+	out[n++] = hex_digits[lrc & 0x0F];
+	out[n++] = CMB_ASF_END_CR;
+	out[n++] = CMB_ASF_END_LF;
 
-	return true;
+	return n;
 }
 
 
 static bool
 validate_lrc (mca_adu_t* adu)
 {
-	return true;
-
-	return calculate_lrc(adu) == adu->data[adu->length - 1];
-}
-
-static uint8_t
-calculate_lrc (mca_adu_t* adu)
-{
-	return 0x00;
-}
-
-static void
-update_lrc (mca_adu_t* adu)
-{
-	adu->data[adu->length - 1] = calculate_lrc(adu);
+	// The LRC is the two's complement of the other bytes' sum, so the sum
+	// accumulated while decoding is zero over a good frame.
+	return 0 == slot_lrc[adu - slots];
 }
@@ -18,10 +18,15 @@
 #define MODBUS_CON_ASCII_H
 
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "modbus_defs.h"
 
 
 #define MCA_FRAME_MAX (252U)
+#define MCA_REPLY_MAX (1U + (2U * MCA_FRAME_MAX) + 2U)  // encoded, SOF to EOF
+#define MCA_RX_SLOTS (4U)  // requests the host can have in flight
 
 
 #ifdef  __cplusplus
@@ -41,7 +46,9 @@ typedef modbus_pdu_t mca_adu_t;
 
 
 void mca_init (void);
-void mca_task (void);
+size_t mca_rx (const char* in, size_t count);  // returns count consumed
+void mca_overflow (void);  // console RX buffer filled up
+bool mca_idle (void);  // between frames
 
 modbus_pdu_t mca_parse_adu (void);
 void mca_send_reply (modbus_pdu_t* pdu);
@@ -0,0 +1,307 @@
+/*
+ * Modbus LL Driver - MBAP/Harmony Console
+ *
+ * @file
+ *   modbus_con_mbap.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Modbus/TCP style MBAP frame/ADU interface. IO via Harmony Console. Each
+ *   frame carries a transaction ID, echoed in its reply, so clients sharing
+ *   the link through a host multiplexer can match up their replies.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../drivers/hang_here.h"
+#include "../drivers/sw_timer.h"
+#include "definitions.h"
+
+#include "modbus_con_mbap.h"
+#include "modbus_defs.h"
+
+
+#define PDU_EMPTY ((modbus_pdu_t){ .data = NULL, .length = 0 })
+
+// Header byte offsets. Fields are big-endian.
+#define MH_TRANSACTION (0U)
+#define MH_PROTOCOL (2U)
+#define MH_LENGTH (4U)  // of the unit ID and PDU
+#define MH_UNIT (6U)
+
+
+static enum
+{
+	MS_IDLE = 0,
+	MS_DATA = 10,
+	MS_DISCARD = 20,
+	MS_FULL = 30,
+}
+mbap_state;
+
+
+// Received frames queue up in slots, oldest at tx_slot, and are replied to
+// in order. rx_adu is the slot being received into.
+static uint8_t adu_data[MCM_RX_SLOTS][MCM_FRAME_MAX] = { { 0 } };
+static modbus_pdu_t slots[MCM_RX_SLOTS];
+static unsigned int rx_slot;
+static unsigned int tx_slot;
+static unsigned int slots_ready;
+static bool taken;  // the frame at tx_slot is with mcm_parse_adu's caller
+static modbus_pdu_t* rx_adu;
+
+static ns_timer_t idle_timer = NS_TIMER(MCM_IDLE_NS);
+
+static bool header_valid (const modbus_pdu_t* adu);
+static void commit_frame (void);
+
+
+void
+mcm_init (void)
+{
+	unsigned int i;
+
+	mbap_state = MS_IDLE;
+
+	for (i = 0; i < MCM_RX_SLOTS; i++)
+	{
+		slots[i].data = adu_data[i];
+		slots[i].length = 0;
+	}
+
+	rx_slot = 0;
+	tx_slot = 0;
+	slots_ready = 0;
+	taken = false;
+	rx_adu = &slots[rx_slot];
+}
+
+
+size_t
+mcm_rx (const char* in, size_t count)
+{
+	size_t i;
+
+	if (0 == count)
+	{
+		return 0;
+	}
+
+	ns_timer_reset(&idle_timer);
+
+	// Stops once every slot holds a frame, leaving the rest with the caller.
+	for (i = 0; (i < count) && (MS_FULL != mbap_state); i++)
+	{
+		switch (mbap_state)
+		{
+			case MS_IDLE:
+			case MS_DATA:
+			{
+				rx_adu->data[rx_adu->length] = (uint8_t)in[i];
+				rx_adu->length++;
+				mbap_state = MS_DATA;
+
+				if (rx_adu->length < MCM_HEADER_LEN)
+				{
+					break;
+				}
+
+				// The header gives the frame length. One that makes no sense
+				// means the stream is out of step, so wait for a quiet line.
+				if (!header_valid(rx_adu))
+				{
+					mb_debug("Bad MBAP header, discarding.");
+					rx_adu->length = 0;
+					mbap_state = MS_DISCARD;
+
+					break;
+				}
+
+				if (rx_adu->length >= (MH_UNIT + ((rx_adu->data[MH_LENGTH] << 8) | rx_adu->data[MH_LENGTH + 1])))
+				{
+					commit_frame();
+				}
+
+				break;
+			}
+
+			case MS_DISCARD:
+			{
+				// Until the line goes idle.
+
+				break;
+			}
+
+			default:
+			{
+				HANG_HERE();
+			}
+		}
+	}
+
+	return i;
+}
+
+void
+mcm_overflow (void)
+{
+	if (MS_FULL != mbap_state)
+	{
+		mb_debug("RX buffer overflow, discarding.");
+		rx_adu->length = 0;
+		mbap_state = MS_DISCARD;
+	}
+}
+
+bool
+mcm_idle (void)
+{
+	return (MS_IDLE == mbap_state) && (0 == slots_ready);
+}
+
+
+modbus_pdu_t
+mcm_parse_adu (void)
+{
+	modbus_pdu_t* adu = &slots[tx_slot];
+	ssize_t free;
+
+	// A partial frame left by a quiet line is dropped, and the line
+	// resynchronises on the next byte.
+	if (((MS_DATA == mbap_state) || (MS_DISCARD == mbap_state)) && ns_timer_expired(&idle_timer))
+	{
+		if (MS_DATA == mbap_state)
+		{
+			mb_debug("Incomplete frame, discarding.");
+		}
+
+		rx_adu->length = 0;
+		mbap_state = MS_IDLE;
+	}
+
+	if (0 == slots_ready)
+	{
+		return PDU_EMPTY;
+	}
+
+	// Leave the frame queued until its reply is sure to fit.
+	free = SYS_CONSOLE_WriteFreeBufferCountGet(sysObj.sysConsole0);
+
+	if (free < 0)
+	{
+		HANG_HERE();
+	}
+	else if ((size_t)free < MCM_FRAME_MAX)
+	{
+		return PDU_EMPTY;
+	}
+
+	taken = true;
+
+	if ((MODBUS_ADDRESS != adu->data[MH_UNIT]) && (MCM_UNIT_ANY != adu->data[MH_UNIT]))
+	{
+		mb_debug("Ignoring frame with wrong unit %d.", adu->data[MH_UNIT]);
+
+		return PDU_EMPTY;
+	}
+
+	return (modbus_pdu_t){
+			   .data = &(adu->data[MCM_HEADER_LEN]),
+			   .length = adu->length - MCM_HEADER_LEN,
+	};
+}
+
+void
+mcm_send_reply (modbus_pdu_t* pdu)
+{
+	modbus_pdu_t* adu = &slots[tx_slot];
+	ssize_t free;
+
+	if ((NULL == pdu) || (pdu->length <= 0))
+	{
+		adu->length = 0;
+
+		return;
+	}
+
+	if (pdu->length > MCM_PDU_MAX)
+	{
+		mb_debug("Overlength reply, won't send.");
+		adu->length = 0;
+
+		return;
+	}
+
+	// The PDU was built in place, after the request's header. The
+	// transaction ID and unit are echoed, so only the length changes.
+	adu->length = MCM_HEADER_LEN + pdu->length;
+	adu->data[MH_LENGTH] = (pdu->length + 1) >> 8;
+	adu->data[MH_LENGTH + 1] = (pdu->length + 1) & 0xFF;
+
+	free = SYS_CONSOLE_WriteFreeBufferCountGet(sysObj.sysConsole0);
+
+	if (free < 0)
+	{
+		HANG_HERE();
+	}
+	else if ((size_t)free < adu->length)
+	{
+		mb_debug("TX overflow, discarding reply.");
+		adu->length = 0;
+
+		return;
+	}
+
+	SYS_CONSOLE_Write(sysObj.sysConsole0, adu->data, adu->length);
+
+	adu->length = 0;
+}
+
+// Call this function when you are done with the result of mcm_parse_adu.
+// Call it even if mcm_parse_adu gave an invalid result.
+void
+mcm_done (void)
+{
+	if (!taken)
+	{
+		return;
+	}
+
+	taken = false;
+	slots[tx_slot].length = 0;
+	tx_slot = (tx_slot + 1) % MCM_RX_SLOTS;
+	slots_ready--;
+
+	if (MS_FULL == mbap_state)
+	{
+		mbap_state = MS_IDLE;
+	}
+}
+
+
+static bool
+header_valid (const modbus_pdu_t* adu)
+{
+	uint16_t protocol = (adu->data[MH_PROTOCOL] << 8) | adu->data[MH_PROTOCOL + 1];
+	uint16_t length = (adu->data[MH_LENGTH] << 8) | adu->data[MH_LENGTH + 1];
+
+	// Protocol 0 is Modbus. The length covers the unit ID and at least a
+	// function code.
+	return (0 == protocol) && (length >= 2) && (length <= (MCM_PDU_MAX + 1));
+}
+
+static void
+commit_frame (void)
+{
+	slots_ready++;
+	rx_slot = (rx_slot + 1) % MCM_RX_SLOTS;
+	rx_adu = &slots[rx_slot];
+	mbap_state = (slots_ready < MCM_RX_SLOTS) ? MS_IDLE : MS_FULL;
+}
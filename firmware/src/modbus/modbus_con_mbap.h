@@ -0,0 +1,57 @@
+/*
+ * Modbus LL Driver - MBAP/Harmony Console
+ *
+ * @file
+ *   modbus_con_mbap.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Modbus/TCP style MBAP frame/ADU interface. IO via Harmony Console. Each
+ *   frame carries a transaction ID, echoed in its reply, so clients sharing
+ *   the link through a host multiplexer can match up their replies.
+ */
+
+#ifndef MODBUS_CON_MBAP_H
+#define MODBUS_CON_MBAP_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "modbus_defs.h"
+
+
+#define MCM_HEADER_LEN (7U)  // transaction, protocol, length, unit
+#define MCM_PDU_MAX (253U)
+#define MCM_FRAME_MAX (MCM_HEADER_LEN + MCM_PDU_MAX)
+#define MCM_IDLE_NS (5000000U)  // gap that resynchronises after a bad header
+#define MCM_RX_SLOTS (4U)  // requests the host can have in flight
+#define MCM_UNIT_ANY (0xFFU)  // accepted as well as MODBUS_ADDRESS
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+void mcm_init (void);
+size_t mcm_rx (const char* in, size_t count);  // returns count consumed
+void mcm_overflow (void);  // console RX buffer filled up
+bool mcm_idle (void);  // between frames
+
+modbus_pdu_t mcm_parse_adu (void);
+void mcm_send_reply (modbus_pdu_t* pdu);
+void mcm_done (void);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* MODBUS_CON_MBAP_H */
@@ -0,0 +1,389 @@
+/*
+ * Modbus LL Driver - RTU/Harmony Console
+ *
+ * @file
+ *   modbus_con_rtu.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Modbus RTU frame/ADU interface. IO via Harmony Console. Frames are
+ *   delimited by an idle gap on the link, and checked with a CRC-16.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../drivers/hang_here.h"
+#include "../drivers/sw_timer.h"
+#include "definitions.h"
+
+#include "modbus_con_rtu.h"
+#include "modbus_defs.h"
+
+
+#define PDU_EMPTY ((modbus_pdu_t){ .data = NULL, .length = 0 })
+
+
+static enum
+{
+	RS_IDLE = 0,
+	RS_DATA = 10,
+	RS_DISCARD = 20,
+	RS_FULL = 30,
+}
+rtu_state;
+
+
+// Received frames queue up in slots, oldest at tx_slot, and are replied to
+// in order. rx_adu is the slot being received into.
+static uint8_t adu_data[MCR_RX_SLOTS][MCR_FRAME_MAX] = { { 0 } };
+static modbus_pdu_t slots[MCR_RX_SLOTS];
+static unsigned int rx_slot;
+static unsigned int tx_slot;
+static unsigned int slots_ready;
+static bool taken;  // the frame at tx_slot is with mcr_parse_adu's caller
+static modbus_pdu_t* rx_adu;
+
+static ns_timer_t idle_timer = NS_TIMER(MCR_IDLE_NS);
+
+static unsigned int frame_length (const modbus_pdu_t* adu);
+static void commit_frame (void);
+
+// CRC-16/MODBUS, reflected polynomial 0xA001, a byte at a time.
+static const uint16_t crc_table[256] = {
+	0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+	0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+	0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+	0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+	0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+	0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+	0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+	0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+	0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+	0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+	0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+	0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+	0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+	0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+	0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+	0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+	0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+	0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+	0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+	0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+	0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+	0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+	0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+	0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+	0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+	0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+	0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+	0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+	0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+	0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+	0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+	0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+
+void
+mcr_init (void)
+{
+	unsigned int i;
+
+	rtu_state = RS_IDLE;
+
+	for (i = 0; i < MCR_RX_SLOTS; i++)
+	{
+		slots[i].data = adu_data[i];
+		slots[i].length = 0;
+	}
+
+	rx_slot = 0;
+	tx_slot = 0;
+	slots_ready = 0;
+	taken = false;
+	rx_adu = &slots[rx_slot];
+}
+
+
+size_t
+mcr_rx (const char* in, size_t count)
+{
+	size_t i;
+
+	if (0 == count)
+	{
+		return 0;
+	}
+
+	ns_timer_reset(&idle_timer);
+
+	// Stops once every slot holds a frame, leaving the rest with the caller.
+	for (i = 0; (i < count) && (RS_FULL != rtu_state); i++)
+	{
+		switch (rtu_state)
+		{
+			case RS_IDLE:
+			case RS_DATA:
+			{
+				unsigned int length;
+
+				if (rx_adu->length >= MCR_FRAME_MAX)
+				{
+					mb_debug("Overlength frame, discarding.");
+					rx_adu->length = 0;
+					rtu_state = RS_DISCARD;
+
+					break;
+				}
+
+				rx_adu->data[rx_adu->length] = (uint8_t)in[i];
+				rx_adu->length++;
+				rtu_state = RS_DATA;
+
+				// Back-to-back requests leave no idle gap, so a frame of a
+				// known function ends at its length.
+				length = frame_length(rx_adu);
+
+				if ((length > 0) && (rx_adu->length >= length))
+				{
+					commit_frame();
+				}
+
+				break;
+			}
+
+			case RS_DISCARD:
+			{
+				// Until the line goes idle.
+
+				break;
+			}
+
+			default:
+			{
+				HANG_HERE();
+			}
+		}
+	}
+
+	return i;
+}
+
+void
+mcr_overflow (void)
+{
+	if (RS_FULL != rtu_state)
+	{
+		mb_debug("RX buffer overflow, discarding.");
+		rx_adu->length = 0;
+		rtu_state = RS_DISCARD;
+	}
+}
+
+bool
+mcr_idle (void)
+{
+	return (RS_IDLE == rtu_state) && (0 == slots_ready);
+}
+
+
+modbus_pdu_t
+mcr_parse_adu (void)
+{
+	modbus_pdu_t* adu = &slots[tx_slot];
+	ssize_t free;
+
+	// Any other frame ends once the line has been quiet for the idle gap.
+	if (((RS_DATA == rtu_state) || (RS_DISCARD == rtu_state)) && ns_timer_expired(&idle_timer))
+	{
+		if (RS_DATA == rtu_state)
+		{
+			commit_frame();
+		}
+		else
+		{
+			rx_adu->length = 0;
+			rtu_state = RS_IDLE;
+		}
+	}
+
+	if (0 == slots_ready)
+	{
+		return PDU_EMPTY;
+	}
+
+	// Leave the frame queued until its reply is sure to fit.
+	free = SYS_CONSOLE_WriteFreeBufferCountGet(sysObj.sysConsole0);
+
+	if (free < 0)
+	{
+		HANG_HERE();
+	}
+	else if ((size_t)free < MCR_FRAME_MAX)
+	{
+		return PDU_EMPTY;
+	}
+
+	taken = true;
+
+	if (adu->length < 4)
+	{
+		mb_debug("Ignoring too-short frame.");
+
+		return PDU_EMPTY;
+	}
+
+	if (MODBUS_ADDRESS != adu->data[0])
+	{
+		mb_debug("Ignoring frame with wrong address %d.", adu->data[0]);
+
+		return PDU_EMPTY;
+	}
+
+	// Running the CRC over its own little-endian value leaves zero.
+	if (0 != mcr_crc(adu->data, adu->length))
+	{
+		mb_debug("Ignoring frame with wrong CRC.");
+
+		return PDU_EMPTY;
+	}
+
+	return (modbus_pdu_t){
+			   .data = &(adu->data[1]),
+			   .length = adu->length - 3,
+	};
+}
+
+void
+mcr_send_reply (modbus_pdu_t* pdu)
+{
+	modbus_pdu_t* adu = &slots[tx_slot];
+	uint16_t crc;
+	ssize_t free;
+
+	if ((NULL == pdu) || (pdu->length <= 0))
+	{
+		adu->length = 0;
+
+		return;
+	}
+
+	adu->length = pdu->length + 3;
+
+	if (adu->length > MCR_FRAME_MAX)
+	{
+		mb_debug("Overlength reply, won't send.");
+		adu->length = 0;
+
+		return;
+	}
+
+	// The PDU was built in place, after the address.
+	adu->data[0] = MODBUS_ADDRESS;
+	crc = mcr_crc(adu->data, adu->length - 2);
+	adu->data[adu->length - 2] = crc & 0xFF;
+	adu->data[adu->length - 1] = crc >> 8;
+
+	free = SYS_CONSOLE_WriteFreeBufferCountGet(sysObj.sysConsole0);
+
+	if (free < 0)
+	{
+		HANG_HERE();
+	}
+	else if ((size_t)free < adu->length)
+	{
+		mb_debug("TX overflow, discarding reply.");
+		adu->length = 0;
+
+		return;
+	}
+
+	SYS_CONSOLE_Write(sysObj.sysConsole0, adu->data, adu->length);
+
+	adu->length = 0;
+}
+
+// Call this function when you are done with the result of mcr_parse_adu.
+// Call it even if mcr_parse_adu gave an invalid result.
+void
+mcr_done (void)
+{
+	if (!taken)
+	{
+		return;
+	}
+
+	taken = false;
+	slots[tx_slot].length = 0;
+	tx_slot = (tx_slot + 1) % MCR_RX_SLOTS;
+	slots_ready--;
+
+	if (RS_FULL == rtu_state)
+	{
+		rtu_state = RS_IDLE;
+	}
+}
+
+
+uint16_t
+mcr_crc (const uint8_t* data, size_t length)
+{
+	uint16_t crc = 0xFFFF;
+	size_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		crc = (crc >> 8) ^ crc_table[(crc ^ data[i]) & 0xFF];
+	}
+
+	return crc;
+}
+
+
+// Whole frame length, once enough of the frame is in to tell, else 0.
+static unsigned int
+frame_length (const modbus_pdu_t* adu)
+{
+	if (adu->length < 2)
+	{
+		return 0;
+	}
+
+	switch (adu->data[1])
+	{
+		case MB_FN_READ_REGS:
+		{
+			// Address, function, start, count and CRC.
+			return 8;
+		}
+
+		case MB_FN_WRITE_REGS:
+		{
+			// As for a read, with the byte count and data before the CRC.
+			return (adu->length < 7) ? 0 : (9 + adu->data[6]);
+		}
+
+		default:
+		{
+			// Up to the idle gap.
+			return 0;
+		}
+	}
+}
+
+static void
+commit_frame (void)
+{
+	slots_ready++;
+	rx_slot = (rx_slot + 1) % MCR_RX_SLOTS;
+	rx_adu = &slots[rx_slot];
+	rtu_state = (slots_ready < MCR_RX_SLOTS) ? RS_IDLE : RS_FULL;
+}
@@ -0,0 +1,55 @@
+/*
+ * Modbus LL Driver - RTU/Harmony Console
+ *
+ * @file
+ *   modbus_con_rtu.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Modbus RTU frame/ADU interface. IO via Harmony Console. Frames are
+ *   delimited by an idle gap on the link, and checked with a CRC-16.
+ */
+
+#ifndef MODBUS_CON_RTU_H
+#define MODBUS_CON_RTU_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "modbus_defs.h"
+
+
+#define MCR_FRAME_MAX (256U)
+#define MCR_IDLE_NS (5000000U)  // gap that ends a frame
+#define MCR_RX_SLOTS (4U)  // requests the host can have in flight
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+void mcr_init (void);
+size_t mcr_rx (const char* in, size_t count);  // returns count consumed
+void mcr_overflow (void);  // console RX buffer filled up
+bool mcr_idle (void);  // between frames
+
+modbus_pdu_t mcr_parse_adu (void);
+void mcr_send_reply (modbus_pdu_t* pdu);
+void mcr_done (void);
+
+uint16_t mcr_crc (const uint8_t* data, size_t length);
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* MODBUS_CON_RTU_H */
@@ -0,0 +1,346 @@
+/*
+ * Modbus ASCII Benchmarks
+ *
+ * @file
+ *   bench_ascii.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Host timings of modbus_con_ascii.c. Frames decoded as read in blocks,
+ *   with hex runs taken by ascii_frame_run(), against the same frames fed a
+ *   character at a time, which is the old path through ascii_frame_sm()
+ *   alone. Replies encoded whole by encode_frame() and sent in one write,
+ *   against the old vsnprintf() and console write per byte. Host cycles are
+ *   not PIC32 cycles, so only the ratios carry over.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "definitions.h"
+#include "modbus_con_ascii.h"
+#include "sim.h"
+#include "test.h"
+
+#define BENCH_CHARS (20000000U)  // decoded per path and frame size
+#define BENCH_REPLY_CHARS (5000000U)  // encoded per path and reply size
+
+
+typedef struct
+{
+	double frames_s;
+	double ns_byte;
+	double cycles_byte;  // zero where there's no cycle counter
+}
+bench_t;
+
+
+static char frame[MCA_REPLY_MAX];
+static size_t frame_len;
+
+
+static uint64_t
+cycles (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static double
+now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((double)ts.tv_sec * 1e9) + (double)ts.tv_nsec;
+}
+
+static void
+make_frame (size_t length)
+{
+	// A write of length - 2 bytes to this device, from SOF to EOF with its
+	// LRC. Lower-case digits in the data keep the decoder's table honest.
+	static const char hex_digits[16] = {
+		'0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+	};
+	uint8_t sum = 0;
+	size_t i;
+
+	frame_len = 0;
+	frame[frame_len++] = CMB_ASF_START;
+
+	for (i = 0; (i + 1) < length; i++)
+	{
+		uint8_t byte = (0 == i) ? MODBUS_ADDRESS : (1 == i) ? 0x10 : (uint8_t)((i * 37) + 11);
+
+		frame[frame_len++] = hex_digits[byte >> 4];
+		frame[frame_len++] = hex_digits[byte & 0x0F];
+		sum += byte;
+	}
+
+	sum = (uint8_t)(-sum);
+	frame[frame_len++] = hex_digits[sum >> 4];
+	frame[frame_len++] = hex_digits[sum & 0x0F];
+	frame[frame_len++] = CMB_ASF_END_CR;
+	frame[frame_len++] = CMB_ASF_END_LF;
+}
+
+static bool
+take_frame (size_t length)
+{
+	// Past the LRC check, the PDU is the frame less address and LRC.
+	modbus_pdu_t pdu = mca_parse_adu();
+	bool good = (NULL != pdu.data) && ((size_t)pdu.length == (length - 2));
+
+	mca_done();
+
+	return good;
+}
+
+static bool
+con_write_safe (const char* fmt, ...)
+{
+	// The old reply path, as it was before encode_frame(): a free space
+	// check, vsnprintf() and console write for every piece of the frame.
+	char buf[100];
+	ssize_t free;
+	va_list args;
+
+	free = SYS_CONSOLE_WriteFreeBufferCountGet(sysObj.sysConsole0);
+
+	if (free < 2)
+	{
+		return false;
+	}
+
+	va_start(args, fmt);
+	vsnprintf(buf, 100, fmt, args);
+	va_end(args);
+
+	// SYS_CONSOLE_Message() is a write of the whole string.
+	SYS_CONSOLE_Write(sysObj.sysConsole0, buf, strlen(buf));
+
+	return true;
+}
+
+static void
+old_send_reply (const modbus_pdu_t* pdu)
+{
+	uint8_t sum = MODBUS_ADDRESS;
+	int i;
+
+	con_write_safe(":");
+	con_write_safe("%02X", MODBUS_ADDRESS);
+
+	for (i = 0; i < pdu->length; i++)
+	{
+		con_write_safe("%02X", pdu->data[i]);
+		sum += pdu->data[i];
+	}
+
+	con_write_safe("%02X", (uint8_t)(-sum));
+	con_write_safe("\r\n");
+}
+
+static size_t
+drain (void)
+{
+	// The host takes the reply, so the next one has room.
+	char reply[MCA_REPLY_MAX];
+
+	return sim_console_receive(reply, sizeof(reply));
+}
+
+static bench_t
+bench_decode (size_t length, bool block)
+{
+	unsigned int frames = BENCH_CHARS / frame_len;
+	unsigned int i, good = 0;
+	uint64_t c0;
+	double t0, ns;
+	bench_t b;
+
+	mca_init();
+	t0 = now_ns();
+	c0 = cycles();
+
+	for (i = 0; i < frames; i++)
+	{
+		if (block)
+		{
+			mca_rx(frame, frame_len);
+		}
+		else
+		{
+			size_t j;
+
+			for (j = 0; j < frame_len; j++)
+			{
+				mca_rx(&frame[j], 1);
+			}
+		}
+
+		good += take_frame(length);
+	}
+
+	b.cycles_byte = (double)(cycles() - c0) / ((double)frames * (double)frame_len);
+	ns = now_ns() - t0;
+	b.frames_s = (double)frames / (ns / 1e9);
+	b.ns_byte = ns / ((double)frames * (double)frame_len);
+
+	CHECK(frames == good);
+
+	return b;
+}
+
+static bench_t
+bench_encode (size_t length, bool whole)
+{
+	// Replies go out in place of the request, as modbus.c sends them.
+	modbus_pdu_t request, pdu;
+	unsigned int replies, i, good = 0;
+	uint64_t c0;
+	double t0, ns;
+	bench_t b;
+
+	make_frame(length + 2);
+	mca_init();
+	mca_rx(frame, frame_len);
+	request = mca_parse_adu();
+	replies = BENCH_REPLY_CHARS / frame_len;
+
+	for (i = 0; i < (unsigned int)request.length; i++)
+	{
+		request.data[i] = (uint8_t)((i * 53) + 7);
+	}
+
+	t0 = now_ns();
+	c0 = cycles();
+
+	for (i = 0; i < replies; i++)
+	{
+		pdu = request;
+
+		if (whole)
+		{
+			mca_send_reply(&pdu);
+		}
+		else
+		{
+			old_send_reply(&pdu);
+		}
+
+		good += (frame_len == drain());
+	}
+
+	b.cycles_byte = (double)(cycles() - c0) / ((double)replies * (double)frame_len);
+	ns = now_ns() - t0;
+	b.frames_s = (double)replies / (ns / 1e9);
+	b.ns_byte = ns / ((double)replies * (double)frame_len);
+	mca_done();
+
+	CHECK(replies == good);
+
+	return b;
+}
+
+
+static void
+test_decode (void)
+{
+	// A short read request, and a write as long as a frame can be.
+	static const size_t lengths[] = { 8, MCA_FRAME_MAX };
+	unsigned int i;
+
+	for (i = 0; i < (sizeof(lengths) / sizeof(lengths[0])); i++)
+	{
+		bench_t chars, block;
+
+		make_frame(lengths[i]);
+		chars = bench_decode(lengths[i], false);
+		block = bench_decode(lengths[i], true);
+
+		REPORT(
+			"decode %3u bytes: per char %9.0f frames/s, %6.2f ns/char, %6.2f cycles/char\n",
+			(unsigned int)lengths[i],
+			chars.frames_s,
+			chars.ns_byte,
+			chars.cycles_byte
+		);
+		REPORT(
+			"decode %3u bytes: block    %9.0f frames/s, %6.2f ns/char, %6.2f cycles/char, %.1fx\n",
+			(unsigned int)lengths[i],
+			block.frames_s,
+			block.ns_byte,
+			block.cycles_byte,
+			block.frames_s / chars.frames_s
+		);
+
+		CHECK(block.frames_s > chars.frames_s);
+	}
+}
+
+static void
+test_encode (void)
+{
+	// A short write reply, and a read reply as long as a frame can be.
+	static const size_t lengths[] = { 5, MCA_FRAME_MAX - 2 };
+	unsigned int i;
+
+	for (i = 0; i < (sizeof(lengths) / sizeof(lengths[0])); i++)
+	{
+		bench_t bytes, whole;
+
+		bytes = bench_encode(lengths[i], false);
+		whole = bench_encode(lengths[i], true);
+
+		REPORT(
+			"encode %3u bytes: per byte %9.0f frames/s, %6.2f ns/char, %6.2f cycles/char\n",
+			(unsigned int)lengths[i],
+			bytes.frames_s,
+			bytes.ns_byte,
+			bytes.cycles_byte
+		);
+		REPORT(
+			"encode %3u bytes: whole    %9.0f frames/s, %6.2f ns/char, %6.2f cycles/char, %.1fx\n",
+			(unsigned int)lengths[i],
+			whole.frames_s,
+			whole.ns_byte,
+			whole.cycles_byte,
+			whole.frames_s / bytes.frames_s
+		);
+
+		CHECK(whole.frames_s > bytes.frames_s);
+	}
+}
+
+
+int
+main (void)
+{
+	sim_init();
+	sim_console_reset();
+
+	test_decode();
+	test_encode();
+
+	return test_result("bench_ascii");
+}
@@ -0,0 +1,27 @@
+/*
+ * GPIO PLIB - Host Simulation
+ *
+ * @file
+ *   plib_gpio.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Stands in for the Harmony GPIO PLIB on the host. HANG_HERE() toggles
+ *   LED3 first thing, so a test that reaches one aborts there.
+ */
+
+#ifndef PLIB_GPIO_H
+#define PLIB_GPIO_H
+
+
+#include <stdlib.h>
+
+
+#define LED3_Toggle() abort()
+
+#endif /* PLIB_GPIO_H */
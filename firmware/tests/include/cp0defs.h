@@ -0,0 +1,33 @@
+/*
+ * CP0 Registers - Host Simulation
+ *
+ * @file
+ *   cp0defs.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Stands in for the XC32 header on the host. CP0 Count reads the simulated
+ *   core timer.
+ */
+
+#ifndef CP0DEFS_H
+#define CP0DEFS_H
+
+
+#include <stdint.h>
+
+
+#define _CP0_COUNT (9)
+#define _CP0_COUNT_SELECT (0)
+
+#define __builtin_mfc0(REG, SEL) ((uint32_t)sim_now)
+
+
+extern uint64_t sim_now;
+
+#endif /* CP0DEFS_H */
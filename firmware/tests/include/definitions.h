@@ -0,0 +1,55 @@
+/*
+ * System Definitions - Host Simulation
+ *
+ * @file
+ *   definitions.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Stands in for the Harmony system definitions on the host, with only the
+ *   console API. sim/console_sim.c implements it.
+ */
+
+#ifndef DEFINITIONS_H
+#define DEFINITIONS_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef uintptr_t SYS_MODULE_OBJ;
+typedef uintptr_t SYS_CONSOLE_HANDLE;
+
+typedef struct
+{
+	SYS_MODULE_OBJ sysConsole0;
+}
+SYSTEM_OBJECTS;
+
+
+extern SYSTEM_OBJECTS sysObj;
+
+ssize_t SYS_CONSOLE_Read (const SYS_CONSOLE_HANDLE handle, void* buf, size_t count);
+ssize_t SYS_CONSOLE_Write (const SYS_CONSOLE_HANDLE handle, const void* buf, size_t count);
+ssize_t SYS_CONSOLE_ReadFreeBufferCountGet (const SYS_CONSOLE_HANDLE handle);
+ssize_t SYS_CONSOLE_WriteFreeBufferCountGet (const SYS_CONSOLE_HANDLE handle);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEFINITIONS_H */
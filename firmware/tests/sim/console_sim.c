@@ -0,0 +1,125 @@
+/*
+ * Console - Host Simulation
+ *
+ * @file
+ *   console_sim.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   The Harmony console API over two byte rings, one each way, the size of
+ *   the USB CDC console's. The test plays the host at the other end.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "definitions.h"
+#include "sim.h"
+
+
+typedef struct
+{
+	uint8_t data[SIM_CONSOLE_LEN];
+	size_t head, tail;  // free-running, so head - tail is the fill
+}
+ring_t;
+
+
+SYSTEM_OBJECTS sysObj;
+
+static ring_t rx, tx;
+
+
+static size_t
+ring_put (ring_t* ring, const uint8_t* in, size_t count)
+{
+	size_t i;
+
+	for (i = 0; (i < count) && ((ring->head - ring->tail) < SIM_CONSOLE_LEN); i++)
+	{
+		ring->data[ring->head % SIM_CONSOLE_LEN] = in[i];
+		ring->head++;
+	}
+
+	return i;
+}
+
+static size_t
+ring_get (ring_t* ring, uint8_t* out, size_t max)
+{
+	size_t i;
+
+	for (i = 0; (i < max) && (ring->tail != ring->head); i++)
+	{
+		out[i] = ring->data[ring->tail % SIM_CONSOLE_LEN];
+		ring->tail++;
+	}
+
+	return i;
+}
+
+
+void
+sim_console_reset (void)
+{
+	rx.head = 0;
+	rx.tail = 0;
+	tx.head = 0;
+	tx.tail = 0;
+}
+
+size_t
+sim_console_room (void)
+{
+	return SIM_CONSOLE_LEN - (rx.head - rx.tail);
+}
+
+size_t
+sim_console_send (const void* data, size_t count)
+{
+	return ring_put(&rx, data, count);
+}
+
+size_t
+sim_console_receive (void* data, size_t max)
+{
+	return ring_get(&tx, data, max);
+}
+
+
+ssize_t
+SYS_CONSOLE_Read (const SYS_CONSOLE_HANDLE handle, void* buf, size_t count)
+{
+	(void)handle;
+
+	return ring_get(&rx, buf, count);
+}
+
+ssize_t
+SYS_CONSOLE_Write (const SYS_CONSOLE_HANDLE handle, const void* buf, size_t count)
+{
+	(void)handle;
+
+	return ring_put(&tx, buf, count);
+}
+
+ssize_t
+SYS_CONSOLE_ReadFreeBufferCountGet (const SYS_CONSOLE_HANDLE handle)
+{
+	(void)handle;
+
+	return sim_console_room();
+}
+
+ssize_t
+SYS_CONSOLE_WriteFreeBufferCountGet (const SYS_CONSOLE_HANDLE handle)
+{
+	(void)handle;
+
+	return SIM_CONSOLE_LEN - (tx.head - tx.tail);
+}
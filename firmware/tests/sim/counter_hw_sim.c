@@ -0,0 +1,651 @@
+/*
+ * Frequency Counter Hardware - Host Simulation
+ *
+ * @file
+ *   counter_hw_sim.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   counter_hw.h for the host tests. Timer1, Timer2/3 and Timer6/7 count the
+ *   simulated inputs edge by edge, overflowing on the very edge the hardware
+ *   would. IC3 latches the core timer on its edges into a 4-deep FIFO. Each
+ *   ISR does what its counter_hw.c namesake does, a latency after the event
+ *   that raised it.
+ */
+
+#include <math.h>
+#include <stddef.h>
+
+#include "counter_hw.h"
+#include "sim.h"
+
+#define IC_FIFO_LEN (4U)
+#define IC_IRQ_FREQUENCY (3U)  // captures per interrupt in frequency mode, ICI = 0b10
+
+
+typedef struct
+{
+	double hz, drift;
+	double phase;  // edges since sim_init, an edge on every whole number
+	double hz_step, phase_step;  // mean frequency and edges over the step in progress
+}
+input_t;
+
+typedef struct
+{
+	sim_input_t input;
+	uint32_t period;
+	unsigned int prescale;
+	double base;  // input phase the count last restarted from
+	bool ie, ifs;
+}
+sim_timer_t;
+
+
+static input_t inputs[SIM_INPUTS];
+static double duty = 0.5;
+static double latency_min, latency_jitter;
+static unsigned long isr_count;
+
+static sim_timer_t timer1, timer23, timer67;
+
+static struct
+{
+	counter_mode_t mode;
+	double next;  // REF phase of the next edge captured
+	bool next_rising;
+	uint32_t fifo[IC_FIFO_LEN];
+	unsigned int fifo_len, irq_level;
+	bool ie, ifs, icov;
+	double isr_at;  // ticks, negative if no ISR is due
+	unsigned long lost;
+}
+ic;
+
+// Start of the step in progress, for timing events inside it, or now
+// between steps.
+static double step_t0;
+
+
+static void ic_restart (double phase);
+
+
+static double
+frand (void)
+{
+	// xorshift64, so every run sees the same latencies.
+	static uint64_t s = 88172645463325252ULL;
+
+	s ^= s << 13;
+	s ^= s >> 7;
+	s ^= s << 17;
+
+	return (double)(s >> 11) / 9007199254740992.0;
+}
+
+static double
+latency (void)
+{
+	return latency_min + (latency_jitter * frand());
+}
+
+static double
+time_at (sim_input_t input, double phase)
+{
+	// Time of an input phase within the step in progress.
+	input_t* in = &inputs[input];
+
+	return step_t0 + (((phase - in->phase) / in->hz_step) * SIM_TICKS_S);
+}
+
+static double
+phase_at (sim_input_t input, double t)
+{
+	input_t* in = &inputs[input];
+
+	return in->phase + ((in->hz_step * (t - step_t0)) / SIM_TICKS_S);
+}
+
+static uint32_t
+timer_count_at (const sim_timer_t* tmr, double phase)
+{
+	double edges = floor(phase) - tmr->base;
+
+	return (uint32_t)fmod(floor(edges / (double)tmr->prescale), (double)tmr->period + 1.0);
+}
+
+static void
+timer_restart (sim_timer_t* tmr)
+{
+	tmr->base = floor(inputs[tmr->input].phase);
+}
+
+static void
+timer_reset (sim_timer_t* tmr, sim_input_t input)
+{
+	tmr->input = input;
+	tmr->period = PR1_MAX;
+	tmr->prescale = 1;
+	tmr->ie = false;
+	tmr->ifs = false;
+	timer_restart(tmr);
+}
+
+static sim_timer_t*
+timer_of (counter_backend_t backend)
+{
+	switch (backend)
+	{
+		case CB_TIMER23:
+		{
+			return &timer23;
+		}
+
+		case CB_TIMER67:
+		{
+			return &timer67;
+		}
+
+		case CB_CAPTURE:
+		{
+			return NULL;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			return &timer1;
+		}
+	}
+}
+
+
+// The ISRs, as in counter_hw.c. Each reads the core timer on entry.
+
+static void
+timer_isr (sim_timer_t* tmr, double t)
+{
+	uint32_t ticks = (uint32_t)(uint64_t)floor(t);
+
+	isr_count++;
+
+	if (&timer1 == tmr)
+	{
+		counter_hw_timestamp(CC_REF, ticks, timer_count_at(&timer23, phase_at(timer23.input, t)));
+	}
+	else if (&timer23 == tmr)
+	{
+		counter_hw_timestamp(CC_REF, ticks, 0);
+	}
+	else
+	{
+		counter_hw_timestamp(CC_X1, ticks, 0);
+	}
+
+	tmr->ifs = false;
+}
+
+static void
+ic_isr (void)
+{
+	bool overflow = ic.icov;
+	unsigned int i;
+
+	isr_count++;
+
+	for (i = 0; i < ic.fifo_len; i++)
+	{
+		counter_hw_timestamp(CC_REF, ic.fifo[i], 0);
+	}
+
+	ic.fifo_len = 0;
+
+	if (overflow)
+	{
+		ic_restart(floor(phase_at(SIM_REF, ic.isr_at)));
+		counter_hw_overrun(CC_REF);
+	}
+
+	ic.ifs = false;
+	ic.isr_at = -1.0;
+}
+
+
+static void
+timer_step (sim_timer_t* tmr)
+{
+	input_t* in = &inputs[tmr->input];
+	double end = in->phase + in->phase_step;
+	double next;
+
+	if (in->phase_step <= 0.0)
+	{
+		return;
+	}
+
+	next = tmr->base + (((double)tmr->period + 1.0) * (double)tmr->prescale);
+
+	while (next <= end)
+	{
+		double t = time_at(tmr->input, next);
+
+		tmr->base = next;
+
+		if (tmr->ie)
+		{
+			timer_isr(tmr, t + latency());
+		}
+		else
+		{
+			tmr->ifs = true;
+		}
+
+		next = tmr->base + (((double)tmr->period + 1.0) * (double)tmr->prescale);
+	}
+}
+
+static void
+ic_capture (double t)
+{
+	if (ic.fifo_len < IC_FIFO_LEN)
+	{
+		// Timer4/5 runs at the core timer rate.
+		ic.fifo[ic.fifo_len] = (uint32_t)(uint64_t)floor(t);
+		ic.fifo_len++;
+	}
+	else
+	{
+		ic.icov = true;
+		ic.lost++;
+	}
+
+	if ((ic.fifo_len >= ic.irq_level) && !ic.ifs)
+	{
+		ic.ifs = true;
+
+		if (ic.ie)
+		{
+			ic.isr_at = t + latency();
+		}
+	}
+}
+
+static void
+ic_advance (void)
+{
+	switch (ic.mode)
+	{
+		case CM_PERIOD:
+		{
+			ic.next += 1.0;
+
+			break;
+		}
+
+		case CM_PULSE:
+		{
+			ic.next += ic.next_rising ? duty : (1.0 - duty);
+			ic.next_rising = !ic.next_rising;
+
+			break;
+		}
+
+		case CM_FREQUENCY:
+		default:
+		{
+			ic.next += (double)IC_EDGES;
+
+			break;
+		}
+	}
+}
+
+static void
+ic_step (double t1)
+{
+	input_t* in = &inputs[SIM_REF];
+	double end = in->phase + in->phase_step;
+
+	while (true)
+	{
+		double t_cap = t1;
+
+		if ((in->phase_step > 0.0) && (ic.next <= end))
+		{
+			t_cap = time_at(SIM_REF, ic.next);
+		}
+
+		if ((ic.isr_at >= 0.0) && (ic.isr_at <= t_cap) && (ic.isr_at < t1))
+		{
+			ic_isr();
+
+			continue;
+		}
+
+		if (t_cap >= t1)
+		{
+			break;
+		}
+
+		ic_capture(t_cap);
+		ic_advance();
+	}
+}
+
+static void
+ic_restart (double phase)
+{
+	// Turning IC3 off and on again, at an input phase.
+	ic.fifo_len = 0;
+	ic.icov = false;
+	ic.next_rising = true;
+
+	switch (ic.mode)
+	{
+		case CM_PERIOD:
+		case CM_PULSE:
+		{
+			ic.next = phase + 1.0;
+			ic.irq_level = 1;
+
+			break;
+		}
+
+		case CM_FREQUENCY:
+		default:
+		{
+			ic.next = phase + (double)IC_EDGES;
+			ic.irq_level = IC_IRQ_FREQUENCY;
+
+			break;
+		}
+	}
+}
+
+static void
+rebase (sim_input_t input)
+{
+	// Takes the whole edges out of an input's phase, and out of everything
+	// counted from it. Kept small, the phase holds a slow input's step in
+	// full, where a large one would round it the same way every time.
+	input_t* in = &inputs[input];
+	double edges = floor(in->phase);
+	sim_timer_t* timers[] = { &timer1, &timer23, &timer67 };
+	unsigned int i;
+
+	in->phase -= edges;
+
+	for (i = 0; i < (sizeof(timers) / sizeof(timers[0])); i++)
+	{
+		if (input == timers[i]->input)
+		{
+			timers[i]->base -= edges;
+		}
+	}
+
+	if (SIM_REF == input)
+	{
+		ic.next -= edges;
+	}
+}
+
+
+void
+sim_step (uint64_t ticks)
+{
+	double dt_s = (double)ticks / SIM_TICKS_S;
+	double t1 = (double)sim_now + (double)ticks;
+	unsigned int i;
+
+	step_t0 = (double)sim_now;
+
+	for (i = 0; i < SIM_INPUTS; i++)
+	{
+		input_t* in = &inputs[i];
+
+		in->hz_step = in->hz + ((in->drift * dt_s) / 2.0);
+
+		if (in->hz_step < 0.0)
+		{
+			in->hz_step = 0.0;
+		}
+
+		in->phase_step = in->hz_step * dt_s;
+	}
+
+	timer_step(&timer1);
+	timer_step(&timer23);
+	timer_step(&timer67);
+	ic_step(t1);
+
+	for (i = 0; i < SIM_INPUTS; i++)
+	{
+		input_t* in = &inputs[i];
+
+		in->phase += in->phase_step;
+		in->hz += in->drift * dt_s;
+
+		if (in->hz < 0.0)
+		{
+			in->hz = 0.0;
+		}
+
+		rebase(i);
+	}
+
+	sim_now += ticks;
+	step_t0 = (double)sim_now;
+}
+
+void
+sim_set_input (sim_input_t input, double hz, double drift)
+{
+	inputs[input].hz = hz;
+	inputs[input].drift = drift;
+}
+
+double
+sim_input_hz (sim_input_t input)
+{
+	return inputs[input].hz;
+}
+
+void
+sim_set_duty (double new_duty)
+{
+	duty = new_duty;
+}
+
+void
+sim_set_latency (double min, double jitter)
+{
+	latency_min = min;
+	latency_jitter = jitter;
+}
+
+unsigned long
+sim_isr_count (void)
+{
+	return isr_count;
+}
+
+unsigned long
+sim_ic_lost (void)
+{
+	return ic.lost;
+}
+
+
+void
+counter_hw_init (void)
+{
+	// Registers as counter_hw.c leaves them.
+	timer_reset(&timer1, SIM_REF);
+	timer_reset(&timer23, SIM_REF);
+	timer_reset(&timer67, SIM_X1);
+
+	ic.mode = CM_FREQUENCY;
+	ic.ie = false;
+	ic.ifs = false;
+	ic.isr_at = -1.0;
+	ic_restart(floor(inputs[SIM_REF].phase));
+}
+
+uint32_t
+counter_hw_period (counter_backend_t backend)
+{
+	sim_timer_t* tmr = timer_of(backend);
+
+	return (NULL == tmr) ? (IC_EDGES - 1) : tmr->period;
+}
+
+uint32_t
+counter_hw_period_min (counter_backend_t backend)
+{
+	return (CB_CAPTURE == backend) ? (IC_EDGES - 1) : PR1_MIN;
+}
+
+uint32_t
+counter_hw_period_max (counter_backend_t backend)
+{
+	switch (backend)
+	{
+		case CB_TIMER23:
+		case CB_TIMER67:
+		{
+			return PR23_MAX;
+		}
+
+		case CB_CAPTURE:
+		{
+			return IC_EDGES - 1;
+		}
+
+		case CB_TIMER1:
+		default:
+		{
+			return PR1_MAX;
+		}
+	}
+}
+
+void
+counter_hw_set_period (counter_backend_t backend, uint32_t period)
+{
+	sim_timer_t* tmr = timer_of(backend);
+
+	if ((NULL == tmr) || (period == tmr->period))
+	{
+		return;
+	}
+
+	tmr->period = period;
+	timer_restart(tmr);
+}
+
+uint32_t
+counter_hw_count (counter_backend_t backend)
+{
+	sim_timer_t* tmr = timer_of(backend);
+
+	return (NULL == tmr) ? 0 : timer_count_at(tmr, inputs[tmr->input].phase);
+}
+
+void
+counter_hw_clear (counter_backend_t backend)
+{
+	sim_timer_t* tmr = timer_of(backend);
+
+	if (NULL == tmr)
+	{
+		ic.fifo_len = 0;
+	}
+	else
+	{
+		timer_restart(tmr);
+	}
+}
+
+unsigned int
+counter_hw_prescale (counter_backend_t backend)
+{
+	return (CB_TIMER1 == backend) ? timer1.prescale : 1;
+}
+
+unsigned int
+counter_hw_prescale_max (counter_backend_t backend)
+{
+	return (CB_TIMER1 == backend) ? 256 : 1;
+}
+
+void
+counter_hw_set_prescale (counter_backend_t backend, unsigned int prescale)
+{
+	if ((CB_TIMER1 == backend) && (prescale != timer1.prescale))
+	{
+		timer1.prescale = prescale;
+		timer_restart(&timer1);
+	}
+}
+
+void
+counter_hw_irq_enable (counter_backend_t backend, bool enable)
+{
+	sim_timer_t* tmr = timer_of(backend);
+
+	if (NULL == tmr)
+	{
+		ic.ie = enable;
+		ic.isr_at = (enable && ic.ifs) ? ((double)sim_now + latency()) : -1.0;
+
+		return;
+	}
+
+	tmr->ie = enable;
+
+	if (enable && tmr->ifs)
+	{
+		timer_isr(tmr, (double)sim_now + latency());
+	}
+}
+
+void
+counter_hw_irq_clear (counter_backend_t backend)
+{
+	sim_timer_t* tmr = timer_of(backend);
+
+	if (NULL == tmr)
+	{
+		ic.ifs = false;
+		ic.isr_at = -1.0;
+	}
+	else
+	{
+		tmr->ifs = false;
+	}
+}
+
+void
+counter_hw_set_capture_mode (counter_mode_t mode)
+{
+	ic.mode = mode;
+	ic_restart(floor(inputs[SIM_REF].phase));
+}
+
+void
+counter_hw_set_ratio_input (bool enable)
+{
+	timer23.input = enable ? SIM_X1 : SIM_REF;
+
+	if (enable)
+	{
+		timer23.period = UINT32_MAX;
+	}
+
+	timer_restart(&timer23);
+}
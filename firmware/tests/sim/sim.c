@@ -0,0 +1,79 @@
+/*
+ * Host Simulation
+ *
+ * @file
+ *   sim.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Simulated core timer, blocking delays and die temperature. The counter
+ *   inputs are in counter_hw_sim.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config/default/peripheral/coretimer/plib_coretimer.h"
+#include "die_temp.h"
+#include "sim.h"
+
+// Starts 5 s short of the core timer's first wrap.
+#define SIM_START (((uint64_t)1 << 32) - (5U * CORE_TIMER_FREQUENCY))
+
+
+uint64_t sim_now = SIM_START;
+
+static bool temp_valid;
+static double temp_c;
+
+
+void
+sim_init (void)
+{
+	// Time only ever runs forwards, as sw_timer extends the core timer from
+	// the last value it saw.
+	if (sim_now < SIM_START)
+	{
+		sim_now = SIM_START;
+	}
+
+	temp_valid = false;
+	temp_c = 0.0;
+}
+
+void
+CORETIMER_DelayMs (uint32_t delay_ms)
+{
+	sim_now += (uint64_t)delay_ms * (CORE_TIMER_FREQUENCY / 1000U);
+}
+
+void
+CORETIMER_DelayUs (uint32_t delay_us)
+{
+	sim_now += (uint64_t)delay_us * (CORE_TIMER_FREQUENCY / 1000000U);
+}
+
+
+void
+sim_set_die_temp (bool valid, double new_temp_c)
+{
+	temp_valid = valid;
+	temp_c = new_temp_c;
+}
+
+bool
+die_temp_valid (void)
+{
+	return temp_valid;
+}
+
+double
+die_temp_c (void)
+{
+	return temp_valid ? temp_c : 0.0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Host Simulation
+ *
+ * @file
+ *   sim.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Simulated time and counter inputs for the host tests. The core timer is
+ *   the low 32 bits of sim_now, which only moves when a test steps it. The
+ *   counter_hw backend counts the simulated inputs edge by edge and runs its
+ *   ISRs, with their latency, as the edges come in. The console is a pair of
+ *   byte rings, with the host at the other end.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define SIM_TICKS_S (48000000.0)  // core timer rate
+#define SIM_CONSOLE_LEN (512U)  // each way, as the USB CDC console rings
+#define SIM_USB_PACKET (64U)  // full speed bulk packet
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef enum
+{
+	SIM_REF = 0,  // REF_PIC, on T1CK, T2CK and IC3
+	SIM_X1,  // PIC_X1, on T6CK, and T2CK in ratio mode
+}
+sim_input_t;
+
+#define SIM_INPUTS (2U)
+
+
+// Core timer ticks since the simulation started, never wrapping. Starts a
+// few seconds short of a 32-bit wrap, so every test crosses one.
+extern uint64_t sim_now;
+
+void sim_init (void);
+
+// Advance time, counting edges and running any ISRs that fall due.
+void sim_step (uint64_t ticks);
+
+// Input frequency, changing at drift Hz/s from now on. Zero is no signal, so
+// a dropout is a zero frequency for a while.
+void sim_set_input (sim_input_t input, double hz, double drift);
+double sim_input_hz (sim_input_t input);
+void sim_set_duty (double duty);  // REF high time, for pulse mode
+
+// Every ISR starts from min to min + jitter ticks after its interrupt, uniform.
+// Hardware captures are latched on the edge itself.
+void sim_set_latency (double min, double jitter);
+
+// ISR entries and timestamps lost to a full IC3 FIFO since sim_init.
+unsigned long sim_isr_count (void);
+unsigned long sim_ic_lost (void);
+
+// Die temperature seen by the timebase.
+void sim_set_die_temp (bool valid, double temp_c);
+
+// The host end of the console. Like Harmony's USB CDC console, a send puts
+// as much as fits into the RX ring and drops the rest, and returns how much
+// went in.
+void sim_console_reset (void);
+size_t sim_console_room (void);
+size_t sim_console_send (const void* data, size_t count);
+size_t sim_console_receive (void* data, size_t max);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_H */
@@ -0,0 +1,51 @@
+/*
+ * Host Test Checks
+ *
+ * @file
+ *   test.h
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   Checks and reports for the host tests. Reports and failures go to stderr,
+ *   leaving stdout to the firmware's own console output. A test's exit status
+ *   is non-zero if any CHECK failed.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+
+#include <stdio.h>
+
+
+#define CHECK(COND) \
+	do \
+	{ \
+		if (!(COND)) \
+		{ \
+			fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #COND); \
+			test_failures++; \
+		} \
+	} \
+	while (0)
+
+#define REPORT(...) fprintf(stderr, __VA_ARGS__)
+
+
+static unsigned int test_failures;
+
+
+static inline int
+test_result (const char* name)
+{
+	REPORT("%s: %s\n", name, (0 == test_failures) ? "passed" : "FAILED");
+
+	return (0 == test_failures) ? 0 : 1;
+}
+
+#endif /* TEST_H */
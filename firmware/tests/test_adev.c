@@ -0,0 +1,118 @@
+/*
+ * Allan Deviation Tests
+ *
+ * @file
+ *   test_adev.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   adev.c against a direct, fully overlapping Allan deviation over the same
+ *   white FM samples, and against white FM's tau^-1/2 slope.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "adev.h"
+#include "test.h"
+
+#define SAMPLES (200000U)
+#define SIGMA (1e-9)  // of each sample, so ADEV at tau0
+
+
+static double x[SAMPLES + 1];  // phase, in units of tau0
+
+
+static double
+gauss (void)
+{
+	// Box-Muller over xorshift64, so every run sees the same samples.
+	static uint64_t s = 88172645463325252ULL;
+	double u1, u2;
+
+	s ^= s << 13;
+	s ^= s >> 7;
+	s ^= s << 17;
+	u1 = ((double)(s >> 11) + 1.0) / 9007199254740993.0;
+	s ^= s << 13;
+	s ^= s >> 7;
+	s ^= s << 17;
+	u2 = (double)(s >> 11) / 9007199254740992.0;
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static double
+adev_direct (unsigned int m)
+{
+	// Every second difference of phase m samples apart.
+	double sum = 0.0;
+	unsigned int i;
+
+	for (i = 0; (i + (2 * m)) <= SAMPLES; i++)
+	{
+		double d = x[i + (2 * m)] - (2.0 * x[i + m]) + x[i];
+
+		sum += d * d;
+	}
+
+	return sqrt(sum / (2.0 * (double)m * (double)m * (double)(SAMPLES + 1 - (2 * m))));
+}
+
+
+static void
+test_white_fm (void)
+{
+	adev_t adev;
+	unsigned int i;
+
+	adev_reset(&adev);
+	x[0] = 0.0;
+
+	for (i = 0; i < SAMPLES; i++)
+	{
+		double y = SIGMA * gauss();
+
+		x[i + 1] = x[i] + y;
+		adev_add(&adev, y, 1.0);
+	}
+
+	CHECK(SAMPLES == adev.samples);
+	CHECK(1.0 == adev.tau0);
+
+	for (i = 0; i < ADEV_LEVELS; i++)
+	{
+		unsigned int m = 1U << i;
+		double direct = adev_direct(m);
+		double theory = SIGMA / sqrt((double)m);
+		double got = adev_get(&adev, i);
+
+		REPORT(
+			"tau %4u: adev %.4e, direct %.4e (%+.2f%%), white FM %.4e (%+.2f%%), %u terms\n",
+			m,
+			got,
+			direct,
+			100.0 * ((got / direct) - 1.0),
+			theory,
+			100.0 * ((got / theory) - 1.0),
+			adev_terms(&adev, i)
+		);
+
+		CHECK(fabs((got / direct) - 1.0) < 0.01);
+		CHECK(fabs((got / theory) - 1.0) < 0.1);
+	}
+}
+
+
+int
+main (void)
+{
+	test_white_fm();
+
+	return test_result("test_adev");
+}
@@ -0,0 +1,850 @@
+/*
+ * Frequency Counter Tests
+ *
+ * @file
+ *   test_counter.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   counter.c against the simulated counter hardware. Reports accuracy,
+ *   settling time and update rate across the input range, and checks each
+ *   against a limit.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "counter.h"
+#include "sim.h"
+#include "stats.h"
+#include "sw_timer.h"
+#include "test.h"
+#include "timebase.h"
+
+#define STEP (SWT_US_TICKS(50))  // superloop period
+#define SETTLE_TOL (1e-6)  // fractional error of a settled result
+
+
+typedef struct
+{
+	double settle_s;  // to the first result within SETTLE_TOL, negative if none
+	unsigned int results;  // from then on
+	double rate;  // results per second, from then on
+	double error;  // mean fractional error, from then on
+	double sd;  // fractional standard deviation, from then on
+	double worst;  // largest fractional error of any result
+}
+run_t;
+
+
+static void
+start (double hz)
+{
+	// Fresh counter on the Timer1 backend, continuous and autoranging. X1 has
+	// a signal of its own, so it counts alongside.
+	sim_set_input(SIM_REF, hz, 0.0);
+	sim_set_input(SIM_X1, 10e6, 0.0);
+	sim_set_latency(0.0, 0.0);
+	timebase_init();
+	counter_init();
+}
+
+static run_t
+run (counter_channel_t ch, double seconds)
+{
+	// Runs the superloop, judging each result against the input at the time.
+	sim_input_t input = (CC_REF == ch) ? SIM_REF : SIM_X1;
+	uint64_t t0 = sim_now;
+	uint64_t end = sim_now + (uint64_t)(seconds * SIM_TICKS_S);
+	uint64_t settled = 0;
+	uint32_t last = counter_result_ticks(ch);
+	run_t r = { -1.0, 0, 0.0, 0.0, 0.0, 0.0 };
+	stats_t err;
+
+	stats_reset(&err);
+
+	while (sim_now < end)
+	{
+		sim_step(STEP);
+		counter_task();
+
+		if (counter_result_ticks(ch) != last)
+		{
+			double e = (counter_freq_hz(ch) / sim_input_hz(input)) - 1.0;
+
+			last = counter_result_ticks(ch);
+
+			if (fabs(e) > r.worst)
+			{
+				r.worst = fabs(e);
+			}
+
+			if ((0 == settled) && (fabs(e) < SETTLE_TOL))
+			{
+				settled = sim_now;
+				r.settle_s = (double)(sim_now - t0) / SIM_TICKS_S;
+			}
+
+			if (settled > 0)
+			{
+				stats_add(&err, e);
+			}
+		}
+	}
+
+	if (settled > 0)
+	{
+		r.results = err.count;
+		r.rate = (double)err.count / ((double)(end - settled) / SIM_TICKS_S);
+		r.error = err.mean;
+		r.sd = stats_stddev(&err);
+	}
+
+	return r;
+}
+
+static void
+report (const char* what, double hz, const run_t* r)
+{
+	REPORT(
+		"%-12s %11.1f Hz: settle %7.3f s, %5u results at %7.2f/s, error %+.2e, sd %.2e\n",
+		what,
+		hz,
+		r->settle_s,
+		r->results,
+		r->rate,
+		r->error,
+		r->sd
+	);
+}
+
+
+static void
+test_sweep (void)
+{
+	// Accuracy, settling and update rate from 1 Hz to 50 MHz. Slow inputs
+	// range up through the timeouts first, and give a result per two edges.
+	// The inputs are a little off round numbers, so their edges fall between
+	// core timer ticks.
+	static const struct
+	{
+		double hz;
+		double seconds;
+		double settle_max;  // s
+		double rate_min;  // results/s
+	}
+	sweep[] = {
+		{ 1.0, 40.0, 12.0, 0.45 },
+		{ 10.0, 20.0, 4.0, 4.5 },
+		{ 100.0, 10.0, 0.5, 12.0 },
+		{ 1e3, 5.0, 0.5, 12.0 },
+		{ 1e4, 5.0, 0.5, 12.0 },
+		{ 1e5, 5.0, 0.5, 12.0 },
+		{ 1e6, 5.0, 0.5, 12.0 },
+		{ 1e7, 5.0, 0.5, 12.0 },
+		{ 50e6, 5.0, 0.5, 12.0 },
+	};
+	unsigned int i;
+
+	for (i = 0; i < (sizeof(sweep) / sizeof(sweep[0])); i++)
+	{
+		double hz = sweep[i].hz * (1.0 + 12.3e-6);
+		run_t r;
+
+		start(hz);
+		r = run(CC_REF, sweep[i].seconds);
+		report("sweep", hz, &r);
+
+		CHECK((r.settle_s >= 0.0) && (r.settle_s < sweep[i].settle_max));
+		CHECK(r.rate > sweep[i].rate_min);
+		CHECK(fabs(r.error) < 1e-8);
+		CHECK(r.sd < 5e-7);
+	}
+}
+
+static void
+test_step (void)
+{
+	// After a step in the input, one estimate from the gate or timeout it
+	// spoils is enough to range onto the new frequency.
+	static const struct
+	{
+		double from, to;
+		double settle_max;  // s
+	}
+	steps[] = {
+		{ 3.0, 50e6, 0.2 },
+		{ 50e6, 3.0, 2.0 },
+		{ 1e6, 37.0, 0.6 },
+		{ 37.0, 1e6, 0.3 },
+	};
+	unsigned int i;
+
+	for (i = 0; i < (sizeof(steps) / sizeof(steps[0])); i++)
+	{
+		double to = steps[i].to * (1.0 + 12.3e-6);
+		run_t before, r;
+
+		start(steps[i].from * (1.0 + 12.3e-6));
+		before = run(CC_REF, 5.0);
+		sim_set_input(SIM_REF, to, 0.0);
+		r = run(CC_REF, 5.0);
+		REPORT("step %11.1f Hz to %11.1f Hz: settle %.3f s\n", steps[i].from, steps[i].to, r.settle_s);
+
+		CHECK(before.settle_s >= 0.0);
+		CHECK((r.settle_s >= 0.0) && (r.settle_s < steps[i].settle_max));
+		CHECK(fabs(r.error) < 5e-7);
+	}
+}
+
+static void
+test_continuous (void)
+{
+	// Back-to-back gates start on the overflow that ended the last, where
+	// single gates each wait out an overflow of their own first, so about
+	// twice the results.
+	static const double hz[] = { 1e3, 1e6, 50e6 };
+	unsigned int i;
+
+	for (i = 0; i < (sizeof(hz) / sizeof(hz[0])); i++)
+	{
+		double f = hz[i] * (1.0 + 12.3e-6);
+		run_t cont, single;
+
+		start(f);
+		cont = run(CC_REF, 5.0);
+		start(f);
+		counter_set_continuous(CC_REF, false);
+		single = run(CC_REF, 5.0);
+		report("continuous", f, &cont);
+		report("single", f, &single);
+
+		CHECK((cont.rate / single.rate) > 1.7);
+		CHECK((cont.rate / single.rate) < 2.3);
+		CHECK(fabs(single.error) < 5e-7);  // a tick's quantisation at 1 kHz
+	}
+}
+
+static void
+test_x1 (void)
+{
+	// The X1 channel counts at the same time, on its own timer.
+	double hz = 3.3e6 * (1.0 + 12.3e-6);
+	run_t r;
+
+	start(1e3);
+	sim_set_input(SIM_X1, hz, 0.0);
+	r = run(CC_X1, 5.0);
+	report("x1", hz, &r);
+
+	CHECK((r.settle_s >= 0.0) && (r.settle_s < 0.5));
+	CHECK(fabs(r.error) < 1e-8);
+	CHECK(r.sd < 5e-7);
+}
+
+static void
+test_drift (void)
+{
+	// Results follow a drifting input, lagging it by about half a gate.
+	run_t r;
+
+	start(10e6);
+	sim_set_input(SIM_REF, 10e6, 0.1);
+	r = run(CC_REF, 10.0);
+	report("drift", 10e6, &r);
+
+	CHECK((r.settle_s >= 0.0) && (r.settle_s < 0.5));
+	CHECK(fabs(r.error) < 1e-8);
+}
+
+static unsigned int
+count_results (double seconds, uint32_t* gap_max)
+{
+	// Results in the next seconds, and the longest gap between two, in ticks.
+	uint64_t end = sim_now + (uint64_t)(seconds * SIM_TICKS_S);
+	uint32_t last = counter_result_ticks(CC_REF);
+	unsigned int results = 0;
+
+	*gap_max = 0;
+
+	while (sim_now < end)
+	{
+		sim_step(STEP);
+		counter_task();
+
+		if (counter_result_ticks(CC_REF) != last)
+		{
+			uint32_t gap = counter_result_ticks(CC_REF) - last;
+
+			if ((results > 0) && (gap > *gap_max))
+			{
+				*gap_max = gap;
+			}
+
+			last = counter_result_ticks(CC_REF);
+			results++;
+		}
+	}
+
+	return results;
+}
+
+static void
+test_fixed_gate (void)
+{
+	// A fixed gate gives one result per gate. Each closes on its last overflow
+	// before the gate time, and the autoranging fits at least 8 in, so results
+	// are at most an eighth of a gate off its cadence. An input with under 2
+	// edges a gate gives a result per 2 edges instead.
+	static const uint32_t gate_ms[] = { 10, 100, 1000 };
+	unsigned int i, results;
+	uint32_t gap_max;
+
+	for (i = 0; i < (sizeof(gate_ms) / sizeof(gate_ms[0])); i++)
+	{
+		double expect = 20.0;
+		double seconds = (expect * (double)gate_ms[i]) / 1000.0;
+
+		start(1.0000123e6);
+		counter_set_gate_ms(CC_REF, gate_ms[i]);
+		run(CC_REF, 1.0 + (3.0 * (double)gate_ms[i] / 1000.0));
+		results = count_results(seconds, &gap_max);
+		REPORT(
+			"fixed gate %4u ms: %u results in %.2f s, longest gap %.3f ms\n",
+			gate_ms[i],
+			results,
+			seconds,
+			(double)gap_max / (SIM_TICKS_S / 1000.0)
+		);
+
+		CHECK(fabs((double)results - expect) <= 1.0);
+		CHECK(gap_max < ((SWT_MS_TICKS(gate_ms[i]) * 9) / 8));
+	}
+
+	start(1e3 * (1.0 + 12.3e-6));
+	counter_set_gate_ms(CC_REF, 1);
+	run(CC_REF, 1.0);
+	results = count_results(1.0, &gap_max);
+	REPORT("fixed gate    1 ms at 1 kHz: %u results in 1 s\n", results);
+
+	CHECK(abs((int)results - 500) <= 1);
+}
+
+static void
+test_jitter (void)
+{
+	// ISR latency jitter lands on every timestamp. It widens the spread of
+	// the results, but leaves their mean alone.
+	double hz = 1.0000123e6;
+	run_t quiet, noisy;
+
+	start(hz);
+	quiet = run(CC_REF, 5.0);
+	start(hz);
+	sim_set_latency(48.0, 96.0);  // 1 us to 3 us
+	noisy = run(CC_REF, 5.0);
+	report("jitter 0", hz, &quiet);
+	report("jitter 2us", hz, &noisy);
+
+	CHECK(noisy.sd > (2.0 * quiet.sd));
+	CHECK(noisy.sd < 3e-5);
+	CHECK(fabs(noisy.error) < (3.0 * noisy.sd / sqrt((double)noisy.results)) + 1e-8);
+}
+
+static void
+test_least_squares (void)
+{
+	// With ISR jitter on every overflow timestamp, fitting a line through all
+	// of a gate's overflows spreads the results less than its first and last
+	// alone. Least squares takes at least 16 overflows a gate.
+	double hz = 1.0000123e6;
+	run_t recip, lsq;
+
+	start(hz);
+	sim_set_latency(48.0, 96.0);  // 1 us to 3 us
+	recip = run(CC_REF, 10.0);
+	start(hz);
+	sim_set_latency(48.0, 96.0);
+	counter_set_estimator(CC_REF, CE_LEAST_SQUARES);
+	lsq = run(CC_REF, 10.0);
+	report("reciprocal", hz, &recip);
+	report("lsq", hz, &lsq);
+
+	CHECK(lsq.sd < (0.7 * recip.sd));
+	CHECK(fabs(lsq.error) < (3.0 * lsq.sd / sqrt((double)lsq.results)) + 1e-8);
+	CHECK(lsq.rate > (0.8 * recip.rate));
+}
+
+static void
+test_lsq_gate (void)
+{
+	// The autoranging holds the overflows per fixed gate and lengthens each
+	// one as the gate grows, so under jitter both estimators fall as 1/tau.
+	// Least squares stays at sqrt(6n / ((n + 1)(n + 2))) of reciprocal, 0.56
+	// at its 16 overflows a gate.
+	static const counter_estimator_t est[] = { CE_RECIPROCAL, CE_LEAST_SQUARES };
+	static const uint32_t gate_ms[] = { 50, 400 };
+	double hz = 1.0000123e6;
+	double sd[2][2];
+	unsigned int e, g;
+
+	for (e = 0; e < 2; e++)
+	{
+		double exponent;
+
+		for (g = 0; g < 2; g++)
+		{
+			run_t r;
+
+			start(hz);
+			sim_set_latency(48.0, 96.0);  // 1 us to 3 us
+			counter_set_estimator(CC_REF, est[e]);
+			counter_set_gate_ms(CC_REF, gate_ms[g]);
+			run(CC_REF, 2.0);
+			r = run(CC_REF, (double)gate_ms[g] / 10.0);  // 100 gates
+			sd[e][g] = r.sd;
+		}
+
+		exponent = log(sd[e][0] / sd[e][1]) / log((double)gate_ms[1] / (double)gate_ms[0]);
+		REPORT(
+			"%-10s gate %u ms sd %.2e, %u ms sd %.2e: tau^-%.2f\n",
+			(CE_RECIPROCAL == est[e]) ? "reciprocal" : "lsq",
+			gate_ms[0],
+			sd[e][0],
+			gate_ms[1],
+			sd[e][1],
+			exponent
+		);
+
+		CHECK((exponent > 0.8) && (exponent < 1.2));
+	}
+
+	for (g = 0; g < 2; g++)
+	{
+		CHECK((sd[1][g] / sd[0][g]) > 0.45);
+		CHECK((sd[1][g] / sd[0][g]) < 0.67);
+	}
+}
+
+static void
+test_kalman (void)
+{
+	// Under ISR jitter the filter takes in every result rather than gating
+	// them out and starting over, and its filtered frequency spreads far less
+	// than the raw results. Its own uncertainty owns up to its error.
+	double hz = 1.0000123e6;
+	uint64_t end;
+	uint32_t last;
+	unsigned int results = 0;
+	bool restarted = false;
+	stats_t raw, filtered;
+	const kalman_t* kf = counter_kalman(CC_REF);
+
+	start(hz);
+	sim_set_latency(48.0, 96.0);  // 1 us to 3 us
+	run(CC_REF, 1.0);
+	counter_set_kalman(CC_REF, true);
+	stats_reset(&raw);
+	stats_reset(&filtered);
+	last = counter_result_ticks(CC_REF);
+	end = sim_now + (20 * SIM_TICKS_S);
+
+	while (sim_now < end)
+	{
+		sim_step(STEP);
+		counter_task();
+
+		if (counter_result_ticks(CC_REF) != last)
+		{
+			last = counter_result_ticks(CC_REF);
+			results++;
+			restarted = restarted || (kf->samples != results);
+			stats_add(&raw, (counter_freq_hz(CC_REF) / hz) - 1.0);
+
+			// Once the filter has settled in.
+			if (results > 20)
+			{
+				stats_add(&filtered, (kf->freq / hz) - 1.0);
+			}
+		}
+	}
+
+	REPORT(
+		"kalman %u results: raw sd %.2e, filtered sd %.2e, error %+.2e, freq sd %.2e\n",
+		results,
+		stats_stddev(&raw),
+		stats_stddev(&filtered),
+		(kf->freq / hz) - 1.0,
+		kalman_freq_sd(kf) / hz
+	);
+
+	CHECK(!restarted);
+	CHECK(results > 100);
+	CHECK(stats_stddev(&filtered) < (0.2 * stats_stddev(&raw)));
+	CHECK(fabs(kf->freq - hz) < (3.0 * kalman_freq_sd(kf)));
+	CHECK(kalman_freq_sd(kf) < (0.5 * stats_stddev(&raw) * hz));
+}
+
+static void
+test_capture (void)
+{
+	// IC3 latches its timestamps in hardware, so the ISR jitter that spreads
+	// Timer1's results leaves these alone. Latency of more than two captures'
+	// worth of edges overflows the FIFO, and the gate starts over rather than
+	// give a result short of edges.
+	double hz = 1.0000123e6;
+	unsigned long lost;
+	run_t quiet, noisy, stalled, r;
+
+	start(hz);
+	counter_set_backend(CB_CAPTURE);
+	quiet = run(CC_REF, 5.0);
+	sim_set_latency(48.0, 96.0);  // 1 us to 3 us
+	noisy = run(CC_REF, 5.0);
+	report("capture 0", hz, &quiet);
+	report("capture 2us", hz, &noisy);
+
+	CHECK((quiet.settle_s >= 0.0) && (quiet.settle_s < 0.5));
+	CHECK(fabs(quiet.error) < 1e-8);
+	CHECK(noisy.sd < (1.5 * quiet.sd));
+	CHECK(noisy.worst < 1e-6);
+
+	lost = sim_ic_lost();
+	sim_set_latency(2400.0, 0.0);  // 50 us, past 32 edges at 1 MHz
+	stalled = run(CC_REF, 1.0);
+	sim_set_latency(48.0, 96.0);
+	r = run(CC_REF, 5.0);
+	report("capture stall", hz, &r);
+
+	CHECK(sim_ic_lost() > lost);
+	CHECK(stalled.worst < 1e-6);
+	CHECK((r.settle_s >= 0.0) && (r.settle_s < 0.5));
+	CHECK(r.worst < 1e-6);
+}
+
+static void
+test_capture_ceiling (void)
+{
+	// Inputs too fast for IC3 to keep up with fall back to Timer1, and settle
+	// there with its usual rate and jitter, where IC3 would lose captures.
+	static const double hz[] = { 5e6, 50e6 };
+	unsigned int i;
+
+	for (i = 0; i < (sizeof(hz) / sizeof(hz[0])); i++)
+	{
+		double f = hz[i] * (1.0 + 12.3e-6);
+		run_t r;
+
+		start(f);
+		counter_set_backend(CB_CAPTURE);
+		sim_set_latency(48.0, 96.0);  // 1 us to 3 us
+		run(CC_REF, 0.2);
+
+		CHECK(CB_TIMER1 == counter_backend());
+
+		r = run(CC_REF, 5.0);
+		report("capture fast", f, &r);
+
+		CHECK(r.rate > 12.0);
+		CHECK(r.sd < 3e-5);
+		CHECK(fabs(r.error) < (3.0 * r.sd / sqrt((double)r.results)) + 1e-8);
+	}
+}
+
+static void
+test_ratio (void)
+{
+	// A/B of REF over X1, taken over the same gates. Both counts come from the
+	// same overflows, so a timebase error that moves the frequency results
+	// leaves the ratio alone. Each gate is good to one count of B.
+	double a = 1.0000123e6;
+	double b = 3.3e6 * (1.0 + 12.3e-6);
+	double tol = 3.0 / (b * 0.07);  // a few counts of B over a 70 ms gate
+	uint64_t end;
+	uint32_t last;
+	stats_t err;
+
+	start(a);
+	sim_set_input(SIM_X1, b, 0.0);
+	counter_set_backend(CB_CAPTURE);
+	counter_set_ratio(true);
+
+	CHECK(counter_ratio_mode());
+	CHECK(CB_TIMER1 == counter_backend());
+	CHECK(0.0 == counter_ratio());
+
+	run(CC_REF, 1.0);
+	timebase_set_ppb(50000.0);  // 50 ppm
+	run(CC_REF, 0.5);
+	stats_reset(&err);
+	end = sim_now + (uint64_t)(5.0 * SIM_TICKS_S);
+	last = counter_result_ticks(CC_REF);
+
+	while (sim_now < end)
+	{
+		sim_step(STEP);
+		counter_task();
+
+		if (counter_result_ticks(CC_REF) != last)
+		{
+			last = counter_result_ticks(CC_REF);
+			stats_add(&err, (counter_ratio() / (a / b)) - 1.0);
+		}
+	}
+
+	REPORT(
+		"ratio        %11.1f Hz: %5u results, freq error %+.2e, ratio error %+.2e, sd %.2e, worst %.2e\n",
+		a,
+		err.count,
+		(counter_freq_hz(CC_REF) / a) - 1.0,
+		err.mean,
+		stats_stddev(&err),
+		fmax(fabs(err.min), fabs(err.max))
+	);
+
+	CHECK(err.count > 50);
+	CHECK(fabs((counter_freq_hz(CC_REF) / a) - 1.0) > 1e-5);
+	CHECK(fabs(err.mean) < 1e-7);
+	CHECK(fabs(err.min) < tol);
+	CHECK(fabs(err.max) < tol);
+
+	counter_set_ratio(false);
+
+	CHECK(!counter_ratio_mode());
+	CHECK(0.0 == counter_ratio());
+	timebase_set_ppb(0.0);
+}
+
+static void
+test_pulse (void)
+{
+	// Period and pulse modes give a result per input cycle, each good to a
+	// core timer tick at either end, so too coarse to settle by run()'s
+	// measure at 1 kHz. Pulse mode adds the high time, here a quarter cycle.
+	static const double hz[] = { 2.0, 1e3 };
+	static const counter_mode_t modes[] = { CM_PERIOD, CM_PULSE };
+	unsigned int i, j;
+
+	for (i = 0; i < (sizeof(hz) / sizeof(hz[0])); i++)
+	{
+		double f = hz[i] * (1.0 + 12.3e-6);
+		double seconds = (f < 10.0) ? 5.0 : 2.0;
+		double tol = 2.0 * f / SIM_TICKS_S;  // fractional, of one cycle
+
+		start(f);
+		sim_set_duty(0.25);
+
+		for (j = 0; j < (sizeof(modes) / sizeof(modes[0])); j++)
+		{
+			const stats_t* s = counter_stats(CC_REF);
+
+			counter_set_mode(modes[j]);
+			counter_stats_reset(CC_REF);
+
+			CHECK(modes[j] == counter_mode());
+			CHECK(0.0 == counter_period_s());
+
+			run(CC_REF, seconds);
+			REPORT(
+				"%-12s %11.1f Hz: %5u results, error %+.2e, worst %.2e, period %.9f s, width %.9f s, duty %.6f\n",
+				(CM_PERIOD == modes[j]) ? "period" : "pulse",
+				f,
+				s->count,
+				(s->mean / f) - 1.0,
+				fmax((s->max / f) - 1.0, 1.0 - (s->min / f)),
+				counter_period_s(),
+				counter_width_s(),
+				counter_duty()
+			);
+
+			CHECK(s->count > (unsigned int)((0.9 * f * seconds) - 2.0));
+			CHECK(fabs((s->mean / f) - 1.0) < 1e-8);  // quantisation averages out
+			CHECK(((s->max / f) - 1.0) < tol);
+			CHECK((1.0 - (s->min / f)) < tol);
+			CHECK(fabs((counter_period_s() * f) - 1.0) < tol);
+			CHECK(fabs((counter_freq_hz(CC_REF) * counter_period_s()) - 1.0) < 1e-12);
+
+			if (CM_PULSE == modes[j])
+			{
+				CHECK(fabs((counter_width_s() * f) - 0.25) < tol);
+				CHECK(fabs(counter_duty() - 0.25) < tol);
+			}
+			else
+			{
+				CHECK(0.0 == counter_width_s());
+				CHECK(0.0 == counter_duty());
+			}
+		}
+
+		sim_set_duty(0.5);
+		counter_set_mode(CM_FREQUENCY);
+	}
+}
+
+static double
+raw_hz (const counter_raw_t* rec)
+{
+	// As the header has it, for the host.
+	double edges = ((double)rec->period + 1.0) * (double)rec->prescale * (double)rec->n;
+
+	return edges / sw_timer_ticks_s(rec->ct_stop - rec->ct_start);
+}
+
+static void
+test_raw (void)
+{
+	// Every result of both channels is kept in one sequence, and gives back its
+	// frequency offline. Left unread past the ring's 128 records, the oldest
+	// are overwritten, which shows as a gap in seq.
+	double hz[COUNTER_CHANNELS] = { 1.0000123e6, 3.3e6 * (1.0 + 12.3e-6) };
+	counter_raw_t recs[16];
+	unsigned int results[COUNTER_CHANNELS] = { 0, 0 };
+	unsigned int i, n, total = 0;
+	uint32_t seq = 0;
+	uint64_t end;
+	bool contiguous = true, match = true;
+	double worst = 0.0;
+
+	start(hz[CC_REF]);
+	sim_set_input(SIM_X1, hz[CC_X1], 0.0);
+
+	CHECK(0 == counter_raw_read(recs, 16));
+
+	end = sim_now + (uint64_t)(3.0 * SIM_TICKS_S);
+
+	while (sim_now < end)
+	{
+		sim_step(STEP);
+		counter_task();
+
+		while ((n = counter_raw_read(recs, 16)) > 0)
+		{
+			for (i = 0; i < n; i++)
+			{
+				double e;
+
+				contiguous = contiguous && (recs[i].seq == (seq + total));
+				total++;
+
+				if (recs[i].channel >= COUNTER_CHANNELS)
+				{
+					match = false;
+
+					continue;
+				}
+
+				results[recs[i].channel]++;
+				e = fabs((raw_hz(&recs[i]) / hz[recs[i].channel]) - 1.0);
+
+				if (e > worst)
+				{
+					worst = e;
+				}
+
+				if (recs[i].ct_stop == counter_result_ticks((counter_channel_t)recs[i].channel))
+				{
+					// The newest record of a channel is its latest result.
+					match = match && (fabs(raw_hz(&recs[i]) - counter_freq_hz((counter_channel_t)recs[i].channel)) < 1e-3);
+				}
+			}
+		}
+	}
+
+	REPORT(
+		"raw          %u records, REF %u, X1 %u, worst %.2e\n",
+		total,
+		results[CC_REF],
+		results[CC_X1],
+		worst
+	);
+
+	CHECK(contiguous);
+	CHECK(match);
+	CHECK(results[CC_REF] > 30);
+	CHECK(results[CC_X1] > 30);
+	CHECK(worst < 1e-6);
+
+	// Unread for long enough to wrap the ring several times over.
+	seq += total;
+	run(CC_REF, 10.0);
+	total = 0;
+	contiguous = true;
+
+	n = counter_raw_read(recs, 1);
+
+	CHECK(1 == n);
+	CHECK(recs[0].seq > seq);
+
+	seq = recs[0].seq + 1;
+	total = 1;
+
+	while ((n = counter_raw_read(recs, 16)) > 0)
+	{
+		for (i = 0; i < n; i++)
+		{
+			contiguous = contiguous && (recs[i].seq == seq);
+			seq++;
+			total++;
+		}
+	}
+
+	REPORT("raw          %u records after overwrite\n", total);
+
+	CHECK(contiguous);
+	CHECK(128 == total);
+}
+
+static void
+test_dropout (void)
+{
+	// A lost input is reported as no frequency, and the counter ranges back
+	// onto it once it returns.
+	double hz = 1e3 * (1.0 + 12.3e-6);
+	run_t r;
+
+	start(hz);
+	run(CC_REF, 2.0);
+	sim_set_input(SIM_REF, 0.0, 0.0);
+	run(CC_REF, 12.0);
+
+	CHECK(0.0 == counter_freq_hz(CC_REF));
+
+	sim_set_input(SIM_REF, hz, 0.0);
+	r = run(CC_REF, 10.0);
+	report("dropout", hz, &r);
+
+	CHECK((r.settle_s >= 0.0) && (r.settle_s < 5.0));
+	CHECK(fabs(r.error) < 1e-8);
+	CHECK(r.sd < 5e-7);
+}
+
+
+int
+main (void)
+{
+	sim_init();
+
+	test_sweep();
+	test_step();
+	test_continuous();
+	test_x1();
+	test_drift();
+	test_fixed_gate();
+	test_jitter();
+	test_least_squares();
+	test_lsq_gate();
+	test_kalman();
+	test_capture();
+	test_capture_ceiling();
+	test_ratio();
+	test_pulse();
+	test_raw();
+	test_dropout();
+
+	return test_result("test_counter");
+}
@@ -0,0 +1,453 @@
+/*
+ * Modbus Tests
+ *
+ * @file
+ *   test_modbus.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   The Modbus driver and its transports against the simulated console, with
+ *   the test as the host. Holding register n reads back as n.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "modbus.h"
+#include "modbus_con_ascii.h"
+#include "modbus_con_mbap.h"
+#include "modbus_con_rtu.h"
+#include "sim.h"
+#include "sw_timer.h"
+#include "test.h"
+
+#define STEP (SWT_US_TICKS(50))  // superloop period, and USB packet spacing
+#define HOST_MAX (16384U)
+
+
+static uint8_t host_out[HOST_MAX];
+static size_t host_out_len;
+static size_t host_sent;
+static uint8_t host_in[HOST_MAX];
+static size_t host_in_len;
+
+
+static bool
+read_regs (mb_reg_data_t* reg_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < reg_data->count; i++)
+	{
+		reg_data->data[i] = reg_data->address + i;
+	}
+
+	return true;
+}
+
+static void
+start (mb_transport_t mode)
+{
+	// The driver is set up once, as on the device. Each test leaves it idle.
+	sim_console_reset();
+	modbus_set_transport(mode);
+	modbus_task();
+
+	host_out_len = 0;
+	host_sent = 0;
+	host_in_len = 0;
+}
+
+static void
+serve (unsigned int loops, size_t packet)
+{
+	// The host streams whatever it has queued up a packet at a time, whenever
+	// a whole one fits, and takes every reply as it comes. USB packets are up
+	// to SIM_USB_PACKET bytes, and smaller ones split frames across reads.
+	unsigned int i;
+
+	for (i = 0; i < loops; i++)
+	{
+		size_t count = host_out_len - host_sent;
+
+		if (count > packet)
+		{
+			count = packet;
+		}
+
+		if (sim_console_room() >= count)
+		{
+			host_sent += sim_console_send(&host_out[host_sent], count);
+		}
+
+		modbus_task();
+		sim_now += STEP;
+		host_in_len += sim_console_receive(&host_in[host_in_len], HOST_MAX - host_in_len);
+	}
+}
+
+static void
+rtu_read (uint16_t address, uint16_t count)
+{
+	uint8_t* f = &host_out[host_out_len];
+	uint16_t crc;
+
+	f[0] = 0;  // MODBUS_ADDRESS
+	f[1] = MB_FN_READ_REGS;
+	f[2] = address >> 8;
+	f[3] = address & 0xFF;
+	f[4] = count >> 8;
+	f[5] = count & 0xFF;
+	crc = mcr_crc(f, 6);
+	f[6] = crc & 0xFF;
+	f[7] = crc >> 8;
+	host_out_len += 8;
+}
+
+static bool
+rtu_check_read (const uint8_t* f, uint16_t address, uint16_t count)
+{
+	// Address, function, byte count, the registers and the CRC, low byte
+	// first.
+	unsigned int length = 3 + (2 * count);
+	uint16_t crc = mcr_crc(f, length);
+	unsigned int i;
+
+	if ((0 != f[0]) || (MB_FN_READ_REGS != f[1]) || ((2 * count) != f[2]))
+	{
+		return false;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (((f[3 + (2 * i)] << 8) | f[4 + (2 * i)]) != (address + i))
+		{
+			return false;
+		}
+	}
+
+	return ((crc & 0xFF) == f[length]) && ((crc >> 8) == f[length + 1]);
+}
+static void
+ascii_read (uint16_t address, uint16_t count, uint8_t lrc_error)
+{
+	// The LRC is the two's complement of the sum of the other bytes.
+	uint8_t f[7] = { 0, MB_FN_READ_REGS, address >> 8, address & 0xFF, count >> 8, count & 0xFF, 0 };
+	uint8_t sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < 6; i++)
+	{
+		sum += f[i];
+	}
+
+	f[6] = (uint8_t)(-sum) + lrc_error;
+	host_out[host_out_len++] = CMB_ASF_START;
+
+	for (i = 0; i < 7; i++)
+	{
+		host_out_len += sprintf((char*)&host_out[host_out_len], "%02X", f[i]);
+	}
+
+	host_out[host_out_len++] = CMB_ASF_END_CR;
+	host_out[host_out_len++] = CMB_ASF_END_LF;
+}
+
+static bool
+ascii_check_read (const uint8_t* line, uint16_t address, uint16_t count)
+{
+	// Address, function, byte count, the registers and the LRC, each as two
+	// hex digits, between a colon and CR LF. The bytes sum to zero.
+	unsigned int length = 3 + (2 * count) + 1;
+	uint8_t f[MCA_FRAME_MAX];
+	uint8_t sum = 0;
+	unsigned int i;
+
+	if ((CMB_ASF_START != line[0]) || (CMB_ASF_END_CR != line[1 + (2 * length)]) || (CMB_ASF_END_LF != line[2 + (2 * length)]))
+	{
+		return false;
+	}
+
+	for (i = 0; i < length; i++)
+	{
+		unsigned int byte;
+
+		if (1 != sscanf((const char*)&line[1 + (2 * i)], "%2X", &byte))
+		{
+			return false;
+		}
+
+		f[i] = byte;
+		sum += byte;
+	}
+
+	if ((0 != f[0]) || (MB_FN_READ_REGS != f[1]) || ((2 * count) != f[2]) || (0 != sum))
+	{
+		return false;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (((f[3 + (2 * i)] << 8) | f[4 + (2 * i)]) != (address + i))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+mbap_read (uint16_t transaction, uint8_t unit, uint16_t address, uint16_t count)
+{
+	uint8_t* f = &host_out[host_out_len];
+
+	f[0] = transaction >> 8;
+	f[1] = transaction & 0xFF;
+	f[2] = 0;  // protocol
+	f[3] = 0;
+	f[4] = 0;  // length, of the unit and PDU
+	f[5] = 6;
+	f[6] = unit;
+	f[7] = MB_FN_READ_REGS;
+	f[8] = address >> 8;
+	f[9] = address & 0xFF;
+	f[10] = count >> 8;
+	f[11] = count & 0xFF;
+	host_out_len += 12;
+}
+
+static bool
+mbap_check_read (const uint8_t* f, uint16_t transaction, uint8_t unit, uint16_t address, uint16_t count)
+{
+	// The header echoes the transaction and unit, with the reply's length.
+	unsigned int length = 3 + (2 * count);
+	unsigned int i;
+
+	if ((((f[0] << 8) | f[1]) != transaction) || (0 != f[2]) || (0 != f[3]) || (((f[4] << 8) | f[5]) != length) || (unit != f[6]))
+	{
+		return false;
+	}
+
+	if ((MB_FN_READ_REGS != f[7]) || ((2 * count) != f[8]))
+	{
+		return false;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (((f[9 + (2 * i)] << 8) | f[10 + (2 * i)]) != (address + i))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static unsigned int
+count_lines (void)
+{
+	unsigned int n = 0;
+	size_t i;
+
+	for (i = 0; i < host_in_len; i++)
+	{
+		if (CMB_ASF_END_LF == host_in[i])
+		{
+			n++;
+		}
+	}
+
+	return n;
+}
+
+
+static void
+test_ascii_lrc (void)
+{
+	// A frame with a bad LRC is ignored, and the ones either side of it are
+	// answered.
+	start(MB_TRANSPORT_ASCII);
+	ascii_read(10, 2, 0);
+	ascii_read(20, 2, 1);
+	ascii_read(30, 2, 0);
+	serve(100, SIM_USB_PACKET);
+
+	REPORT("ascii lrc: %u replies to 2 good and 1 bad request\n", count_lines());
+
+	CHECK(2 == count_lines());
+}
+static void
+test_ascii_reply (void)
+{
+	// A reply carries the registers and an LRC that checks.
+	start(MB_TRANSPORT_ASCII);
+	ascii_read(42, 3, 0);
+	serve(100, SIM_USB_PACKET);
+
+	REPORT("ascii reply: %.*s", (int)host_in_len, (const char*)host_in);
+
+	CHECK(1 == count_lines());
+	CHECK(((1 + (2 * 10) + 2) == host_in_len) && ascii_check_read(host_in, 42, 3));
+}
+
+static void
+test_rtu_pipeline (void)
+{
+	// Far more requests back to back than there are frame slots. The console
+	// fills behind the full slots, and that has to hold the rest back rather
+	// than throw them away.
+	unsigned int n = 200;
+	unsigned int good = 0;
+	unsigned int i;
+
+	start(MB_TRANSPORT_RTU);
+
+	for (i = 0; i < n; i++)
+	{
+		rtu_read(i % 50, 2);
+	}
+
+	serve(5000, SIM_USB_PACKET);
+
+	for (i = 0; (i < n) && (((i + 1) * 9) <= host_in_len); i++)
+	{
+		if (rtu_check_read(&host_in[i * 9], i % 50, 2))
+		{
+			good++;
+		}
+	}
+
+	REPORT("rtu pipeline: %u requests, %u good replies, %zu bytes\n", n, good, host_in_len);
+
+	CHECK(n == good);
+	CHECK((n * 9) == host_in_len);
+}
+
+static void
+test_mbap_split (void)
+{
+	// Frames arriving a few bytes at a time, the header split across reads,
+	// are put back together.
+	static const size_t packets[] = { 1, 3, 5, 7, 11 };
+	unsigned int i;
+
+	for (i = 0; i < (sizeof(packets) / sizeof(packets[0])); i++)
+	{
+		start(MB_TRANSPORT_MBAP);
+		mbap_read(0x1234 + i, MODBUS_ADDRESS, 100 + i, 4);
+		serve(200, packets[i]);
+
+		CHECK((17 == host_in_len) && mbap_check_read(host_in, 0x1234 + i, MODBUS_ADDRESS, 100 + i, 4));
+	}
+}
+
+static void
+test_mbap_back_to_back (void)
+{
+	// Frames back to back in one packet, more of them than there are frame
+	// slots, are each answered in order.
+	unsigned int n = 5;
+	unsigned int good = 0;
+	unsigned int i;
+
+	start(MB_TRANSPORT_MBAP);
+
+	for (i = 0; i < n; i++)
+	{
+		mbap_read(i, MODBUS_ADDRESS, 10 * i, 1);
+	}
+
+	serve(200, SIM_USB_PACKET);
+
+	for (i = 0; (i < n) && (((i + 1) * 11) <= host_in_len); i++)
+	{
+		if (mbap_check_read(&host_in[i * 11], i, MODBUS_ADDRESS, 10 * i, 1))
+		{
+			good++;
+		}
+	}
+
+	REPORT("mbap back to back: %u of %u in one packet answered\n", good, n);
+
+	CHECK(n == good);
+	CHECK((n * 11) == host_in_len);
+}
+
+static void
+test_mbap_unit (void)
+{
+	// Only our own unit ID, or 0xFF, is answered. A frame for another unit
+	// is still a whole frame, so the one after it is read correctly.
+	start(MB_TRANSPORT_MBAP);
+	mbap_read(1, 0x05, 10, 1);
+	mbap_read(2, MCM_UNIT_ANY, 20, 1);
+	mbap_read(3, MODBUS_ADDRESS, 30, 1);
+	serve(200, SIM_USB_PACKET);
+
+	CHECK(22 == host_in_len);
+	CHECK(mbap_check_read(&host_in[0], 2, MCM_UNIT_ANY, 20, 1));
+	CHECK(mbap_check_read(&host_in[11], 3, MODBUS_ADDRESS, 30, 1));
+}
+
+static void
+test_mbap_bad_header (void)
+{
+	// A length or protocol that makes no sense loses the frame boundaries,
+	// so everything is dropped until the line goes quiet for MCM_IDLE_NS.
+	static const struct
+	{
+		unsigned int offset;
+		uint8_t value;
+	}
+	bad[] = {
+		{ 5, 0 },  // length too short for a function code
+		{ 4, 1 },  // length past MCM_PDU_MAX + 1
+		{ 3, 1 },  // protocol not Modbus
+	};
+	unsigned int idle_loops = (SWT_NS_TICKS(MCM_IDLE_NS) / STEP) + 2;
+	unsigned int i;
+
+	for (i = 0; i < (sizeof(bad) / sizeof(bad[0])); i++)
+	{
+		start(MB_TRANSPORT_MBAP);
+		mbap_read(1, MODBUS_ADDRESS, 10, 1);
+		host_out[bad[i].offset] = bad[i].value;
+		mbap_read(2, MODBUS_ADDRESS, 20, 1);
+		serve(idle_loops, SIM_USB_PACKET);
+
+		CHECK(0 == host_in_len);
+
+		mbap_read(3, MODBUS_ADDRESS, 30, 1);
+		serve(100, SIM_USB_PACKET);
+
+		CHECK((11 == host_in_len) && mbap_check_read(host_in, 3, MODBUS_ADDRESS, 30, 1));
+	}
+}
+
+
+int
+main (void)
+{
+	sim_init();
+	modbus_init();
+	modbus_add_reg_handler(0, 1000, MB_RA_READ, read_regs);
+
+	test_ascii_lrc();
+	test_ascii_reply();
+	test_rtu_pipeline();
+	test_mbap_split();
+	test_mbap_back_to_back();
+	test_mbap_unit();
+	test_mbap_bad_header();
+
+	return test_result("test_modbus");
+}
@@ -0,0 +1,149 @@
+/*
+ * Software Timer Tests
+ *
+ * @file
+ *   test_sw_timer.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   sw_timer.c across 32-bit core timer wraps. Each test moves the simulated
+ *   core timer up to just short of a wrap, so the timers under test straddle
+ *   one.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+#include "sw_timer.h"
+#include "test.h"
+
+#define WRAP ((uint64_t)1 << 32)
+
+
+static void
+before_wrap (uint64_t ticks)
+{
+	// Reads the timer on the way, as the superloop would, so the extension
+	// sees every wrap.
+	uint64_t wrap = ((sim_now / WRAP) + 1) * WRAP;
+
+	if ((wrap - sim_now) < ticks)
+	{
+		wrap += WRAP;
+	}
+
+	if ((wrap - sim_now) > (WRAP / 2))
+	{
+		sim_now = wrap - (WRAP / 2);
+		(void)sw_timer_ticks64();
+	}
+
+	sim_now = wrap - ticks;
+}
+
+
+static void
+test_ticks64 (void)
+{
+	// The extended timer carries every wrap, and never steps back.
+	uint64_t t0, t1, t2;
+	unsigned int i;
+	bool monotonic = true;
+
+	before_wrap(1000);
+	t0 = sw_timer_ticks64();
+	sim_now += 999;
+	t1 = sw_timer_ticks64();
+	sim_now += 2;
+	t2 = sw_timer_ticks64();
+
+	CHECK((t1 - t0) == 999);
+	CHECK((t2 - t0) == 1001);
+	CHECK(0 == (uint32_t)(t2 - 1));
+
+	// Several wraps, read a few times each.
+	for (i = 0; i < 12; i++)
+	{
+		sim_now += (WRAP / 4) + 7;
+		t1 = sw_timer_ticks64();
+		monotonic = monotonic && (t1 > t2);
+		t2 = t1;
+	}
+
+	CHECK(monotonic);
+	CHECK((t2 - t0) == (1001 + (12 * ((WRAP / 4) + 7))));
+}
+
+static void
+test_sw_timer (void)
+{
+	// Expires once more than its length in ms has passed, wrap or no wrap.
+	sw_timer_t timer = SW_TIMER(100);
+	sw_timer_t capture = SW_TIMER(0);
+	uint64_t length = SWT_MS_TICKS(100);
+
+	before_wrap(length / 2);
+	sw_timer_reset(&timer);
+	sw_timer_reset(&capture);
+	sim_now += length;
+
+	CHECK(!sw_timer_expired(&timer));
+	CHECK(100 == sw_timer_elapsed(&timer));
+
+	sim_now += 1;
+
+	CHECK(sw_timer_expired(&timer));
+
+	// A paused timer holds its elapsed time through a whole wrap more.
+	sw_timer_pause(&capture);
+	sim_now += WRAP / 2;
+	(void)sw_timer_ticks64();
+	sim_now += WRAP / 2;
+
+	CHECK(100 == sw_timer_elapsed(&capture));
+	CHECK((length + 1) == sw_timer_elapsed_ticks(&capture));
+}
+
+static void
+test_ns_timer (void)
+{
+	// Tick resolution on either side of a wrap.
+	ns_timer_t timer = NS_TIMER(50000);
+	uint64_t length = SWT_NS_TICKS(50000);
+
+	before_wrap(10);
+	ns_timer_reset(&timer);
+	sim_now += length;
+
+	CHECK(!ns_timer_expired(&timer));
+	CHECK(length == ns_timer_elapsed_ticks(&timer));
+
+	sim_now += 1;
+
+	CHECK(ns_timer_expired(&timer));
+
+	ns_timer_pause(&timer);
+	sim_now += 1000;
+
+	CHECK((length + 1) == ns_timer_elapsed_ticks(&timer));
+	CHECK((ns_timer_elapsed(&timer) > 50000.0) && (ns_timer_elapsed(&timer) < 50100.0));
+}
+
+
+int
+main (void)
+{
+	sim_init();
+
+	test_ticks64();
+	test_sw_timer();
+	test_ns_timer();
+
+	return test_result("test_sw_timer");
+}
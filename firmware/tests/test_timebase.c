@@ -0,0 +1,173 @@
+/*
+ * Timebase Tests
+ *
+ * @file
+ *   test_timebase.c
+ *
+ * @date
+ *   2026-10-17
+ *
+ * @par
+ *   Copyright 2026 Frequencer Team
+ *
+ * @brief
+ *   The temperature model fit and correction in timebase.c, against
+ *   simulated die temperatures and reference results.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+
+#include "sim.h"
+#include "sw_timer.h"
+#include "test.h"
+#include "timebase.h"
+
+
+// Core timer error of the simulated board, in ppb against die temperature.
+static const double board[TB_MODEL_TERMS] = { 120.0, -35.0, 1.8 };
+
+
+static bool
+coef_near (const double* coef, double c0, double c1, double c2, double tol)
+{
+	return (fabs(coef[0] - c0) < tol) && (fabs(coef[1] - c1) < tol) && (fabs(coef[2] - c2) < tol);
+}
+
+
+static void
+test_fit (void)
+{
+	// Exact data gives back its coefficients, over as many terms as the
+	// temperature span supports. The rest are zero.
+	tb_fit_t fit;
+	double coef[TB_MODEL_TERMS];
+	double t;
+
+	tb_fit_reset(&fit);
+
+	CHECK(!tb_fit_solve(&fit, coef));
+	CHECK(coef_near(coef, 0.0, 0.0, 0.0, 1e-12));
+
+	for (t = 15.0; t <= 45.0; t += 0.5)
+	{
+		tb_fit_add(&fit, t, timebase_model_ppb(board, t));
+	}
+
+	CHECK(tb_fit_solve(&fit, coef));
+	CHECK(coef_near(coef, board[0], board[1], board[2], 1e-6));
+	REPORT("fit quadratic: %.6f %.6f %.6f\n", coef[0], coef[1], coef[2]);
+
+	// Under 2 C of span fits only the constant, the mean.
+	tb_fit_reset(&fit);
+	tb_fit_add(&fit, 30.0, 10.0);
+	tb_fit_add(&fit, 31.0, 20.0);
+	tb_fit_solve(&fit, coef);
+
+	CHECK(coef_near(coef, 15.0, 0.0, 0.0, 1e-9));
+
+	// Under 4 C fits a line.
+	tb_fit_reset(&fit);
+
+	for (t = 25.0; t <= 28.0; t += 0.25)
+	{
+		tb_fit_add(&fit, t, 50.0 - (4.0 * (t - TB_TEMP_REF)));
+	}
+
+	tb_fit_solve(&fit, coef);
+
+	CHECK(coef_near(coef, 50.0, -4.0, 0.0, 1e-9));
+
+	// One temperature over and over can't support a slope, whatever the
+	// span check says.
+	tb_fit_reset(&fit);
+	tb_fit_add(&fit, 20.0, 7.0);
+	tb_fit_add(&fit, 20.0, 9.0);
+	tb_fit_add(&fit, 20.0, 8.0);
+	tb_fit_solve(&fit, coef);
+
+	CHECK(coef_near(coef, 8.0, 0.0, 0.0, 1e-9));
+}
+
+static void
+update_at (double temp_c, double ref_hz)
+{
+	// A reference result, as measured with the correction in use by a core
+	// timer off by the board's error at this temperature.
+	double e = timebase_model_ppb(board, temp_c) / 1e9;
+
+	sim_set_die_temp(true, temp_c);
+	timebase_compensate();
+	timebase_update(ref_hz * sw_timer_scale() / (1.0 + e));
+}
+
+static void
+test_learning (void)
+{
+	// Learning across a temperature sweep recovers the board's model, which
+	// then corrects the core timer at any temperature without a reference.
+	double coef[TB_MODEL_TERMS];
+	double t;
+
+	timebase_init();
+	timebase_set_reference(10e6);
+	timebase_set_learning(true);
+
+	for (t = 20.0; t <= 40.0; t += 0.25)
+	{
+		update_at(t, 10e6);
+	}
+
+	timebase_set_learning(false);
+	timebase_model(coef);
+	REPORT("learnt model: %.6f %.6f %.6f\n", coef[0], coef[1], coef[2]);
+
+	CHECK(coef_near(coef, board[0], board[1], board[2], 1e-3));
+
+	timebase_set_reference(0.0);
+
+	for (t = 10.0; t <= 50.0; t += 5.0)
+	{
+		sim_set_die_temp(true, t);
+		timebase_compensate();
+
+		CHECK(fabs(timebase_temp_ppb() - timebase_model_ppb(board, t)) < 0.01);
+		CHECK(fabs(sw_timer_scale() - (1.0 + (timebase_model_ppb(board, t) / 1e9))) < 1e-11);
+	}
+
+	// No reading holds the last correction.
+	sim_set_die_temp(false, 0.0);
+	timebase_compensate();
+
+	CHECK(fabs(timebase_temp_ppb() - timebase_model_ppb(board, 50.0)) < 0.01);
+
+	// Relearning with the model applied fits the whole error again, so the
+	// model is replaced, not added to.
+	timebase_set_reference(10e6);
+	timebase_set_learning(true);
+
+	for (t = 20.0; t <= 40.0; t += 0.25)
+	{
+		update_at(t, 10e6);
+	}
+
+	timebase_set_learning(false);
+	timebase_model(coef);
+
+	CHECK(coef_near(coef, board[0], board[1], board[2], 1e-3));
+
+	timebase_init();
+	sim_set_die_temp(false, 0.0);
+}
+
+
+int
+main (void)
+{
+	sim_init();
+
+	test_fit();
+	test_learning();
+
+	return test_result("test_timebase");
+}